@@ -0,0 +1,490 @@
+#include <iostream>
+#include <sstream>
+#include <olc_net.h>
+
+// Headless load generator for capacity planning. Simulates thousands of clients, spread over a
+// few asio context threads, all speaking the same protocol as SampleClient.
+//
+// Load is open loop: messages are sent on a fixed schedule whether or not the server is keeping
+// up, and latency is measured from when each message was *meant* to be sent. A server that stalls
+// therefore shows up as a latency spike for everything scheduled during the stall, rather than
+// quietly slowing the generator down (coordinated omission).
+//
+// What is measured is the round trip as the client sees it, not time spent inside the server:
+// network, kernel and the generator's own receive thread are all included. The server can't
+// report its own share without changing the ping reply SampleClient expects, so for that use
+// the server's tracing (EnableTracing()/DumpTrace()) alongside a run.
+//
+// LoadGenerator [--host 127.0.0.1] [--port 60000] [--clients 1000] [--rate 10000]
+//               [--duration 30] [--ramp 5] [--threads 2] [--mix ping:80,int:15,all:5]
+//               [--profile system|low_latency|bulk|fan_out]
+
+enum class CustomMsgTypes : uint32_t
+{
+	ServerAccept,
+	ServerDeny,
+	ServerPing,
+	MessageAll,
+	ServerMessage,
+	TestInt
+};
+
+using LoadConnection = olc::net::connection<CustomMsgTypes>;
+using LoadMessage = olc::net::message<CustomMsgTypes>;
+
+// Carried by pings and echoed back by the server
+struct Probe
+{
+	int64_t nIntended = 0;	// Scheduled send time, steady clock nanoseconds
+	uint32_t nClient = 0;
+	uint32_t nSeq = 0;
+};
+
+struct Options
+{
+	std::string sHost = "127.0.0.1";
+	uint16_t nPort = 60000;
+	size_t nClients = 1000;
+	double dRate = 10000.0;		// Messages per second, across all clients
+	double dDuration = 30.0;	// Seconds of load, after the ramp
+	double dRamp = 5.0;			// Seconds over which clients connect
+	size_t nThreads = 2;
+	std::vector<std::pair<CustomMsgTypes, uint32_t>> vMix = {
+		{ CustomMsgTypes::ServerPing, 80 }, { CustomMsgTypes::TestInt, 15 }, { CustomMsgTypes::MessageAll, 5 } };
+	olc::net::socket_profile nProfile = olc::net::socket_profile::system;
+};
+
+int64_t NowNanos()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Log-linear latency histogram: 64 linear sub-buckets per power of two microseconds,
+// so every percentile is within about 1.5% of the true value
+class LatencyHistogram
+{
+public:
+	void Record(int64_t nNanos)
+	{
+		uint64_t nMicros = uint64_t(std::max<int64_t>(nNanos, 0) / 1000);
+		std::scoped_lock lock(muxHistogram);
+		vBuckets[BucketOf(nMicros)]++;
+		nCount++;
+		nMax = std::max(nMax, nMicros);
+	}
+
+	// Latency in microseconds below which fraction dQuantile of samples fall
+	uint64_t Percentile(double dQuantile)
+	{
+		std::scoped_lock lock(muxHistogram);
+		uint64_t nTarget = uint64_t(dQuantile * nCount);
+		uint64_t nSeen = 0;
+		for (size_t i = 0; i < vBuckets.size(); i++)
+		{
+			nSeen += vBuckets[i];
+			if (nSeen > nTarget)
+				return std::min(UpperBoundOf(i), nMax);
+		}
+		return nMax;
+	}
+
+	uint64_t Count()
+	{
+		std::scoped_lock lock(muxHistogram);
+		return nCount;
+	}
+
+	uint64_t Max()
+	{
+		std::scoped_lock lock(muxHistogram);
+		return nMax;
+	}
+
+	void Reset()
+	{
+		std::scoped_lock lock(muxHistogram);
+		std::fill(vBuckets.begin(), vBuckets.end(), 0);
+		nCount = 0;
+		nMax = 0;
+	}
+
+private:
+	static constexpr size_t SUB_BUCKETS = 64;
+
+	// Below 128us every microsecond has its own bucket. Above, [64 << k, 128 << k) is split
+	// into SUB_BUCKETS buckets of width 1 << k, at 64 + k * SUB_BUCKETS onwards
+	static size_t BucketOf(uint64_t nMicros)
+	{
+		if (nMicros < 2 * SUB_BUCKETS)
+			return size_t(nMicros);
+
+		size_t nPower = 0;
+		while ((nMicros >> nPower) >= 2 * SUB_BUCKETS)
+			nPower++;
+		return SUB_BUCKETS + nPower * SUB_BUCKETS + size_t((nMicros >> nPower) - SUB_BUCKETS);
+	}
+
+	static uint64_t UpperBoundOf(size_t nBucket)
+	{
+		if (nBucket < 2 * SUB_BUCKETS)
+			return nBucket;
+
+		size_t nPower = nBucket / SUB_BUCKETS - 1;
+		return ((uint64_t(nBucket % SUB_BUCKETS + SUB_BUCKETS) + 1) << nPower) - 1;
+	}
+
+	std::mutex muxHistogram;
+	std::vector<uint64_t> vBuckets = std::vector<uint64_t>(SUB_BUCKETS * 64, 0);
+	uint64_t nCount = 0;
+	uint64_t nMax = 0;
+};
+
+class LoadGenerator
+{
+public:
+	LoadGenerator(const Options& opt)
+		: m_opt(opt), m_vContexts(std::max(opt.nThreads, size_t(1)))
+	{
+		// Turn the mix into a weighted lookup, one slot per percent of weight
+		for (auto& [id, nWeight] : m_opt.vMix)
+			for (uint32_t i = 0; i < nWeight; i++)
+				m_vSchedule.push_back(id);
+
+		m_pTuning = std::make_shared<const olc::net::socket_tuning>(olc::net::socket_tuning::For(m_opt.nProfile));
+	}
+
+	int Run()
+	{
+		if (m_vSchedule.empty())
+		{
+			std::cerr << "[LOAD] Empty message mix\n";
+			return 1;
+		}
+
+		// Keep every context alive until we say so, then give each its own thread
+		std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> vWork;
+		for (auto& context : m_vContexts)
+		{
+			vWork.push_back(boost::asio::make_work_guard(context));
+			m_vThreads.emplace_back([&context]() { context.run(); });
+		}
+
+		boost::asio::ip::tcp::resolver resolver(m_vContexts[0]);
+		m_endpoints = resolver.resolve(m_opt.sHost, std::to_string(m_opt.nPort));
+
+		std::thread thrReceive([this]() { ReceiveLoop(); });
+		std::thread thrSend([this]() { SendLoop(); });
+
+		RampAndReport();
+
+		m_bRunning = false;
+		thrSend.join();
+
+		// Give stragglers a moment, anything not back by then counts as a timeout
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		m_bReceiving = false;
+		m_qMessagesIn.push_back({});
+		thrReceive.join();
+
+		PrintSummary();
+
+		for (auto& client : m_vClients)
+			client->Disconnect();
+		for (auto& context : m_vContexts)
+			context.stop();
+		for (auto& thread : m_vThreads)
+			thread.join();
+		return 0;
+	}
+
+private:
+	// Connect clients at a steady pace over the ramp, then hold the load for the duration,
+	// printing a line of stats every second
+	void RampAndReport()
+	{
+		auto tStart = std::chrono::steady_clock::now();
+		auto tNextReport = tStart + std::chrono::seconds(1);
+		double dTotal = m_opt.dRamp + m_opt.dDuration;
+
+		while (true)
+		{
+			double dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+			if (dElapsed >= dTotal)
+				break;
+
+			size_t nWanted = m_opt.dRamp > 0.0
+				? std::min(m_opt.nClients, size_t(m_opt.nClients * std::min(dElapsed / m_opt.dRamp, 1.0)) + 1)
+				: m_opt.nClients;
+			while (m_nClientCount < nWanted)
+				AddClient();
+
+			if (std::chrono::steady_clock::now() >= tNextReport)
+			{
+				PrintInterval(dElapsed);
+				tNextReport += std::chrono::seconds(1);
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	void AddClient()
+	{
+		auto& context = m_vContexts[m_nClientCount % m_vContexts.size()];
+		auto client = std::make_unique<LoadConnection>(LoadConnection::owner::client,
+			context, boost::asio::ip::tcp::socket(context), m_qMessagesIn);
+
+		client->SetSocketTuning(m_pTuning);
+		client->ConnectToServer(m_endpoints);
+
+		std::scoped_lock lock(muxClients);
+		m_vClients.push_back(std::move(client));
+		m_nClientCount++;
+	}
+
+	// The open loop: message k is due at start + k / rate, no matter what happened to message k-1
+	void SendLoop()
+	{
+		auto tInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(1.0 / std::max(m_opt.dRate, 1e-3)));
+		auto tNext = std::chrono::steady_clock::now();
+		uint64_t nMessage = 0;
+
+		while (m_bRunning)
+		{
+			std::this_thread::sleep_until(tNext);
+
+			// If we've fallen behind, catch up without skipping - those late messages are exactly
+			// the ones whose latency we need to see
+			auto tNow = std::chrono::steady_clock::now();
+			while (tNext <= tNow && m_bRunning)
+			{
+				SendOne(nMessage++, std::chrono::duration_cast<std::chrono::nanoseconds>(tNext.time_since_epoch()).count());
+				tNext += tInterval;
+			}
+		}
+	}
+
+	void SendOne(uint64_t nMessage, int64_t nIntended)
+	{
+		LoadConnection* client = nullptr;
+		uint32_t nClient = 0;
+		{
+			std::scoped_lock lock(muxClients);
+			if (!m_vClients.empty())
+			{
+				nClient = uint32_t(nMessage % m_vClients.size());
+				client = m_vClients[nClient].get();
+			}
+		}
+
+		if (!client || !client->IsConnected())
+		{
+			m_nSendErrors++;
+			return;
+		}
+
+		LoadMessage msg;
+		msg.header.id = m_vSchedule[nMessage % m_vSchedule.size()];
+
+		switch (msg.header.id)
+		{
+		case CustomMsgTypes::ServerPing:
+		{
+			Probe probe;
+			probe.nIntended = nIntended;
+			probe.nClient = nClient;
+			probe.nSeq = uint32_t(nMessage);
+			msg << probe;
+			client->Send(msg, olc::net::priority::control);
+			m_nPingsSent++;
+		}
+		break;
+		case CustomMsgTypes::TestInt:
+		{
+			msg << int(nClient);
+			client->Send(msg);
+		}
+		break;
+		default:
+			client->Send(msg);
+			break;
+		}
+
+		m_nSent++;
+	}
+
+	void ReceiveLoop()
+	{
+		while (m_bReceiving)
+		{
+			m_qMessagesIn.wait();
+			while (!m_qMessagesIn.empty())
+			{
+				auto msg = m_qMessagesIn.pop_front().msg;
+				m_nReceived++;
+
+				switch (msg.header.id)
+				{
+				case CustomMsgTypes::ServerPing:
+				{
+					if (msg.body.size() == sizeof(Probe))
+					{
+						Probe probe;
+						msg >> probe;
+						m_latency.Record(NowNanos() - probe.nIntended);
+						m_total.Record(NowNanos() - probe.nIntended);
+						m_nPingsReceived++;
+					}
+				}
+				break;
+				case CustomMsgTypes::ServerDeny:
+					m_nDenied++;
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	}
+
+	size_t CountConnected()
+	{
+		std::scoped_lock lock(muxClients);
+		size_t nConnected = 0;
+		for (auto& client : m_vClients)
+			if (client->IsConnected())
+				nConnected++;
+		return nConnected;
+	}
+
+	void PrintInterval(double dElapsed)
+	{
+		std::cout << "[LOAD] t=" << int(dElapsed) << "s"
+			<< " clients=" << CountConnected() << "/" << m_nClientCount
+			<< " sent=" << m_nSent << " recv=" << m_nReceived
+			<< " rtt p50=" << m_latency.Percentile(0.50) << "us"
+			<< " p99=" << m_latency.Percentile(0.99) << "us"
+			<< " p99.9=" << m_latency.Percentile(0.999) << "us"
+			<< " max=" << m_latency.Max() << "us"
+			<< " send_errors=" << m_nSendErrors << "\n";
+		m_latency.Reset();
+	}
+
+	void PrintSummary()
+	{
+		size_t nConnected = CountConnected();
+		uint64_t nLost = m_nPingsSent > m_nPingsReceived ? m_nPingsSent - m_nPingsReceived : 0;
+
+		std::cout << "[LOAD] ---- Summary ----\n"
+			<< "[LOAD] Clients:   " << nConnected << " connected of " << m_nClientCount << " opened\n"
+			<< "[LOAD] Messages:  " << m_nSent << " sent, " << m_nReceived << " received\n"
+			<< "[LOAD] Round trip (client observed, not server side):\n"
+			<< "[LOAD]            p50=" << m_total.Percentile(0.50) << "us p90=" << m_total.Percentile(0.90)
+			<< "us p99=" << m_total.Percentile(0.99) << "us p99.9=" << m_total.Percentile(0.999)
+			<< "us max=" << m_total.Max() << "us (" << m_total.Count() << " pings, from intended send time)\n"
+			<< "[LOAD] Errors:    " << m_nSendErrors << " unsendable, " << nLost << " pings unanswered, "
+			<< m_nDenied << " denied, " << (m_nClientCount - nConnected) << " connections lost\n";
+	}
+
+private:
+	Options m_opt;
+	std::vector<CustomMsgTypes> m_vSchedule;
+
+	// A few contexts, each run by one thread, shared out between all the clients
+	std::deque<boost::asio::io_context> m_vContexts;
+	std::vector<std::thread> m_vThreads;
+	boost::asio::ip::tcp::resolver::results_type m_endpoints;
+	std::shared_ptr<const olc::net::socket_tuning> m_pTuning;
+
+	std::mutex muxClients;
+	std::vector<std::unique_ptr<LoadConnection>> m_vClients;
+	std::atomic<size_t> m_nClientCount = 0;
+
+	// Every simulated client reports into the same queue
+	olc::net::tsqueue<olc::net::owned_message<CustomMsgTypes>> m_qMessagesIn;
+
+	std::atomic<bool> m_bRunning = true;
+	std::atomic<bool> m_bReceiving = true;
+
+	std::atomic<uint64_t> m_nSent = 0;
+	std::atomic<uint64_t> m_nReceived = 0;
+	std::atomic<uint64_t> m_nPingsSent = 0;
+	std::atomic<uint64_t> m_nPingsReceived = 0;
+	std::atomic<uint64_t> m_nSendErrors = 0;
+	std::atomic<uint64_t> m_nDenied = 0;
+
+	// Per report interval, and over the whole run
+	LatencyHistogram m_latency;
+	LatencyHistogram m_total;
+};
+
+bool ParseMix(const std::string& sMix, Options& opt)
+{
+	opt.vMix.clear();
+
+	std::stringstream ss(sMix);
+	std::string sItem;
+	while (std::getline(ss, sItem, ','))
+	{
+		size_t nColon = sItem.find(':');
+		if (nColon == std::string::npos)
+			return false;
+
+		std::string sName = sItem.substr(0, nColon);
+		uint32_t nWeight = uint32_t(std::stoul(sItem.substr(nColon + 1)));
+
+		if (sName == "ping") opt.vMix.push_back({ CustomMsgTypes::ServerPing, nWeight });
+		else if (sName == "int") opt.vMix.push_back({ CustomMsgTypes::TestInt, nWeight });
+		else if (sName == "all") opt.vMix.push_back({ CustomMsgTypes::MessageAll, nWeight });
+		else return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	Options opt;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string sArg = argv[i];
+		std::string sValue = argv[i + 1];
+
+		if (sArg == "--host") opt.sHost = sValue;
+		else if (sArg == "--port") opt.nPort = uint16_t(std::stoul(sValue));
+		else if (sArg == "--clients") opt.nClients = std::stoul(sValue);
+		else if (sArg == "--rate") opt.dRate = std::stod(sValue);
+		else if (sArg == "--duration") opt.dDuration = std::stod(sValue);
+		else if (sArg == "--ramp") opt.dRamp = std::stod(sValue);
+		else if (sArg == "--threads") opt.nThreads = std::stoul(sValue);
+		else if (sArg == "--profile")
+		{
+			if (!olc::net::parse_socket_profile(sValue, opt.nProfile))
+			{
+				std::cerr << "[LOAD] Unknown socket profile " << sValue << "\n";
+				return 1;
+			}
+		}
+		else if (sArg == "--mix")
+		{
+			if (!ParseMix(sValue, opt))
+			{
+				std::cerr << "[LOAD] Bad mix, expected e.g. ping:80,int:15,all:5\n";
+				return 1;
+			}
+		}
+		else
+		{
+			std::cerr << "[LOAD] Unknown option " << sArg << "\n";
+			return 1;
+		}
+	}
+
+	std::cout << "[LOAD] " << opt.nClients << " clients -> " << opt.sHost << ":" << opt.nPort
+		<< " at " << opt.dRate << " msgs/s for " << opt.dDuration << "s after a " << opt.dRamp << "s ramp\n";
+
+	LoadGenerator generator(opt);
+	return generator.Run();
+}
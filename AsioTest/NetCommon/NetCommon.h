@@ -4,13 +4,32 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <optional>
 #include <vector>
+#include <array>
+#include <new>
+#include <type_traits>
+#include <concepts>
+
+#if __has_include(<version>)
+#include <version>
+#endif
+#if defined(__cpp_lib_span)
+#include <span>
+#endif
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <random>
 #include <chrono>
 #include <cstdint>
+#include <string>
+#include <fstream>
+#include <filesystem>
 
 #ifdef _WIN32
 #define _WIN32_WINNT 0x0A00
@@ -18,6 +37,21 @@
 
 #define ASIO_STANDALONE
 
+// Define OLC_NET_IO_URING before including the library to run all socket I/O through
+// io_uring instead of epoll on Linux. Needs Boost 1.78 or later and linking with -luring
+#if defined(OLC_NET_IO_URING) && defined(__linux__)
+#include <boost/version.hpp>
+#if BOOST_VERSION < 107800
+#error "OLC_NET_IO_URING needs Boost 1.78 or later"
+#endif
+#if !__has_include(<liburing.h>)
+#error "OLC_NET_IO_URING needs liburing (e.g. the liburing-dev package)"
+#endif
+#include <liburing.h>
+#define BOOST_ASIO_HAS_IO_URING
+#define BOOST_ASIO_DISABLE_EPOLL
+#endif
+
 #pragma warning(push)
 #pragma warning(disable:6255)
 #pragma warning(disable:6387)
@@ -30,4 +64,29 @@
 #pragma warning(disable:26451)
 #pragma warning(disable:26439)
 #include <boost/asio.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+// Define OLC_NET_TLS to be able to run connections over TLS. Needs OpenSSL (-lssl -lcrypto)
+#ifdef OLC_NET_TLS
+#include <boost/asio/ssl.hpp>
+#endif
 #pragma warning(pop)
+
+#if defined(OLC_NET_IO_URING) && defined(__linux__)
+namespace olc
+{
+	namespace net
+	{
+		// Built for io_uring, but the kernel may be too old for it, or have it switched off
+		// (kernel.io_uring_disabled, or a seccomp filter in a container). Try setting up a ring
+		inline bool io_uring_available()
+		{
+			io_uring ring;
+			if (io_uring_queue_init(1, &ring, 0) != 0)
+				return false;
+			io_uring_queue_exit(&ring);
+			return true;
+		}
+	}
+}
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "NetCommon.h"
+#include "net_trace.h"
+#include "net_body.h"
 
 namespace olc
 {
@@ -13,13 +15,20 @@ namespace olc
 		{
 			T id{};
 			uint32_t size = 0;
+
+			// CRC32C of the frame, only filled in when both sides agreed to use checksums
+			uint32_t checksum = 0;
 		};
 
 		template <typename T>
 		struct message
 		{
 			message_header<T> header{};
-			std::vector<uint8_t> body;
+			message_body body;
+
+			// Stage timestamps, if this message was sampled for tracing. Never sent, and only
+			// a pointer unless sampled
+			message_trace trace;
 
 			// return size of entire message packet in bytes
 			size_t size() const
@@ -85,6 +94,137 @@ namespace olc
 				// Return the target message so it can be "chained"
 				return msg;
 			}
+
+			// Bulk versions of the above, for contiguous ranges of POD-like data. The whole range is
+			// copied in with one resize and one memcpy, then its element count is pushed on top so
+			// the range can be pulled back out without knowing its length in advance
+
+			// Pushes nCount POD-like elements, followed by the element count. Throws if nCount
+			// doesn't fit in the 32 bit count
+			template<typename DataType>
+			message<T>& push_range(const DataType* pData, size_t nCount)
+			{
+				static_assert(std::is_standard_layout<DataType>::value, "Data is too complex to be pushed into vector");
+
+				// The count goes on the wire as 32 bits, so a longer range couldn't be pulled back out
+				if (nCount > UINT32_MAX)
+					throw std::length_error("push_range count does not fit in 32 bits");
+
+				uint32_t nElements = static_cast<uint32_t>(nCount);
+				size_t nBytes = sizeof(DataType) * nCount;
+				size_t i = body.size();
+
+				// One resize for the elements and their count together
+				body.resize(i + nBytes + sizeof(uint32_t));
+
+				if (nBytes > 0)
+					std::memcpy(body.data() + i, pData, nBytes);
+				std::memcpy(body.data() + i + nBytes, &nElements, sizeof(uint32_t));
+
+				header.size = static_cast<uint32_t>(size());
+				return *this;
+			}
+
+			// Pulls a range pushed by push_range, replacing the contents of the container
+			template<typename Container>
+			message<T>& pull_range(Container& data)
+			{
+				try_pull_range(data);
+				return *this;
+			}
+
+			// As above, but the count comes off the wire and can't be trusted: if the body is too
+			// short for it, nothing is pulled, the container is emptied and false is returned
+			template<typename Container>
+			bool try_pull_range(Container& data)
+			{
+				using DataType = typename Container::value_type;
+				static_assert(std::is_standard_layout<DataType>::value, "Data is too complex to be pulled from vector");
+
+				// The element count is on top of the stack
+				uint32_t nElements = 0;
+				if (body.size() < sizeof(uint32_t))
+				{
+					data.clear();
+					return false;
+				}
+				size_t i = body.size() - sizeof(uint32_t);
+				std::memcpy(&nElements, body.data() + i, sizeof(uint32_t));
+
+				// ...with the elements themselves underneath it. Checked by division, so a huge
+				// count can't overflow its way past
+				if (nElements > i / sizeof(DataType))
+				{
+					data.clear();
+					return false;
+				}
+				size_t nBytes = sizeof(DataType) * nElements;
+				i -= nBytes;
+				data.resize(nElements);
+				if (nBytes > 0)
+					std::memcpy(data.data(), body.data() + i, nBytes);
+
+				body.resize(i);
+				header.size = static_cast<uint32_t>(size());
+				return true;
+			}
+
+			friend message<T>& operator << (message<T>& msg, const std::string& data)
+			{
+				return msg.push_range(data.data(), data.size());
+			}
+
+			friend message<T>& operator >> (message<T>& msg, std::string& data)
+			{
+				return msg.pull_range(data);
+			}
+
+			template<typename DataType>
+			friend message<T>& operator << (message<T>& msg, const std::vector<DataType>& data)
+			{
+				return msg.push_range(data.data(), data.size());
+			}
+
+			template<typename DataType>
+			friend message<T>& operator >> (message<T>& msg, std::vector<DataType>& data)
+			{
+				return msg.pull_range(data);
+			}
+
+			// Arrays know their length at compile time, so they go in as one block with no count,
+			// exactly as they would through the single value operators
+			template<typename DataType, size_t N>
+			friend message<T>& operator << (message<T>& msg, const std::array<DataType, N>& data)
+			{
+				static_assert(std::is_standard_layout<DataType>::value, "Data is too complex to be pushed into vector");
+
+				size_t i = msg.body.size();
+				msg.body.resize(i + sizeof(DataType) * N);
+				std::memcpy(msg.body.data() + i, data.data(), sizeof(DataType) * N);
+				msg.header.size = static_cast<uint32_t>(msg.size());
+				return msg;
+			}
+
+			template<typename DataType, size_t N>
+			friend message<T>& operator >> (message<T>& msg, std::array<DataType, N>& data)
+			{
+				static_assert(std::is_standard_layout<DataType>::value, "Data is too complex to be pulled from vector");
+
+				size_t i = msg.body.size() - sizeof(DataType) * N;
+				std::memcpy(data.data(), msg.body.data() + i, sizeof(DataType) * N);
+				msg.body.resize(i);
+				msg.header.size = static_cast<uint32_t>(msg.size());
+				return msg;
+			}
+
+#if defined(__cpp_lib_span)
+			// Spans are pushed like vectors, pull them back out into a vector
+			template<typename DataType, size_t Extent>
+			friend message<T>& operator << (message<T>& msg, std::span<DataType, Extent> data)
+			{
+				return msg.push_range(data.data(), data.size());
+			}
+#endif
 		};
 
 
@@ -109,5 +249,20 @@ namespace olc
 				return os;
 			}
 		};
+
+		// A run of received messages that all have the same ID, in the order they arrived.
+		// Only valid for the duration of the call it is passed to
+		template <typename T>
+		struct message_batch
+		{
+			owned_message<T>* pData = nullptr;
+			size_t nCount = 0;
+
+			size_t size() const { return nCount; }
+			bool empty() const { return nCount == 0; }
+			owned_message<T>& operator[](size_t i) const { return pData[i]; }
+			owned_message<T>* begin() const { return pData; }
+			owned_message<T>* end() const { return pData + nCount; }
+		};
 	}
 }
\ No newline at end of file
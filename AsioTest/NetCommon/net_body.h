@@ -0,0 +1,148 @@
+#pragma once
+
+#include "NetCommon.h"
+
+// Define OLC_NET_INLINE_BODY_BYTES before including the library to change how big a message
+// body can get before it has to go on the heap. Every message pays for the whole buffer, used or
+// not: at the default 32 bytes, aligned to 16, a body takes 64 bytes where std::vector<uint8_t>
+// took 24, so each queued message grows by 40 bytes
+#ifndef OLC_NET_INLINE_BODY_BYTES
+#define OLC_NET_INLINE_BODY_BYTES 32
+#endif
+
+namespace olc
+{
+	namespace net
+	{
+		constexpr size_t MESSAGE_INLINE_BYTES = OLC_NET_INLINE_BODY_BYTES;
+
+		// The bytes of a message body. Works like the std::vector<uint8_t> it replaces, but keeps
+		// bodies of up to MESSAGE_INLINE_BYTES inside the message itself, so the small fixed
+		// layout messages that make up most traffic (a ping's timestamp, a single int) never
+		// allocate. Bigger bodies move to the heap, and stay there when cleared so the buffer
+		// can be reused. Both kinds of storage are aligned as new would align them
+		class message_body
+		{
+		public:
+			using value_type = uint8_t;
+			using iterator = uint8_t*;
+			using const_iterator = const uint8_t*;
+
+			message_body() = default;
+
+			message_body(const message_body& other)
+			{
+				assign(other.begin(), other.end());
+			}
+
+			message_body(message_body&& other) noexcept
+			{
+				Take(other);
+			}
+
+			~message_body()
+			{
+				delete[] m_pHeap;
+			}
+
+			message_body& operator=(const message_body& other)
+			{
+				if (this != &other)
+					assign(other.begin(), other.end());
+				return *this;
+			}
+
+			message_body& operator=(message_body&& other) noexcept
+			{
+				if (this != &other)
+				{
+					delete[] m_pHeap;
+					m_pHeap = nullptr;
+					Take(other);
+				}
+				return *this;
+			}
+
+		public:
+			uint8_t* data() { return m_pHeap ? m_pHeap : m_inline.data(); }
+			const uint8_t* data() const { return m_pHeap ? m_pHeap : m_inline.data(); }
+
+			size_t size() const { return m_nSize; }
+			bool empty() const { return m_nSize == 0; }
+			size_t capacity() const { return m_pHeap ? m_nCapacity : MESSAGE_INLINE_BYTES; }
+
+			// True once the body has outgrown the message and moved to the heap
+			bool on_heap() const { return m_pHeap != nullptr; }
+
+			iterator begin() { return data(); }
+			iterator end() { return data() + m_nSize; }
+			const_iterator begin() const { return data(); }
+			const_iterator end() const { return data() + m_nSize; }
+
+			uint8_t& operator[](size_t i) { return data()[i]; }
+			const uint8_t& operator[](size_t i) const { return data()[i]; }
+
+			void reserve(size_t nBytes)
+			{
+				if (nBytes > capacity())
+					Grow(nBytes);
+			}
+
+			// New bytes are zeroed, as with std::vector
+			void resize(size_t nBytes)
+			{
+				if (nBytes > capacity())
+					Grow(std::max(nBytes, capacity() * 2));
+				if (nBytes > m_nSize)
+					std::memset(data() + m_nSize, 0, nBytes - m_nSize);
+				m_nSize = nBytes;
+			}
+
+			void clear()
+			{
+				m_nSize = 0;
+			}
+
+			template<typename Iterator>
+			void assign(Iterator first, Iterator last)
+			{
+				size_t nBytes = size_t(std::distance(first, last));
+				m_nSize = 0;
+				reserve(nBytes);
+				std::copy(first, last, data());
+				m_nSize = nBytes;
+			}
+
+		private:
+			void Grow(size_t nCapacity)
+			{
+				uint8_t* pHeap = new uint8_t[nCapacity];
+				std::memcpy(pHeap, data(), m_nSize);
+				delete[] m_pHeap;
+				m_pHeap = pHeap;
+				m_nCapacity = nCapacity;
+			}
+
+			// Steal other's heap buffer, or copy its inline bytes, leaving it empty
+			void Take(message_body& other)
+			{
+				if (other.m_pHeap)
+				{
+					m_pHeap = std::exchange(other.m_pHeap, nullptr);
+					m_nCapacity = std::exchange(other.m_nCapacity, 0);
+				}
+				else
+				{
+					std::memcpy(m_inline.data(), other.m_inline.data(), other.m_nSize);
+				}
+				m_nSize = std::exchange(other.m_nSize, 0);
+			}
+
+		private:
+			uint8_t* m_pHeap = nullptr;
+			size_t m_nSize = 0;
+			size_t m_nCapacity = 0;
+			alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) std::array<uint8_t, MESSAGE_INLINE_BYTES> m_inline;
+		};
+	}
+}
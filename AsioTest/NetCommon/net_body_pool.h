@@ -0,0 +1,60 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "net_body.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// Message bodies that have been handled, kept for connections to read the next ones into.
+		// A received body is moved, not copied, all the way to the handler, which leaves the
+		// connection without a buffer; it takes one from here rather than allocating afresh.
+		// The server gives them back once Update() has dispatched them. Only bodies too big to
+		// be kept inline are worth keeping
+		class body_pool
+		{
+		public:
+			// Keeps up to nMaxBuffers, and none bigger than nMaxCapacity bytes, so one huge
+			// message doesn't pin its memory for good
+			body_pool(size_t nMaxBuffers = 256, size_t nMaxCapacity = 64 * 1024)
+				: m_nMaxBuffers(nMaxBuffers), m_nMaxCapacity(nMaxCapacity)
+			{
+
+			}
+
+			body_pool(const body_pool&) = delete;
+
+		public:
+			// An empty buffer, with whatever capacity it had when it was given back
+			message_body Acquire()
+			{
+				std::scoped_lock lock(muxPool);
+				if (m_vFree.empty())
+					return {};
+
+				message_body body = std::move(m_vFree.back());
+				m_vFree.pop_back();
+				return body;
+			}
+
+			void Release(message_body&& body)
+			{
+				if (!body.on_heap() || body.capacity() > m_nMaxCapacity)
+					return;
+
+				body.clear();
+				std::scoped_lock lock(muxPool);
+				if (m_vFree.size() < m_nMaxBuffers)
+					m_vFree.push_back(std::move(body));
+			}
+
+		private:
+			size_t m_nMaxBuffers = 0;
+			size_t m_nMaxCapacity = 0;
+
+			std::mutex muxPool;
+			std::vector<message_body> m_vFree;
+		};
+	}
+}
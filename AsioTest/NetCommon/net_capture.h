@@ -0,0 +1,114 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "NetMessage.h"
+#include "net_mapped_log.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// Every record in a capture starts with this, followed by the message body
+		template <typename T>
+		struct capture_record_header
+		{
+			// Nanoseconds since epoch, when the message was dispatched
+			int64_t nTimestamp = 0;
+			uint32_t nConnectionID = 0;
+			uint32_t nReserved = 0;
+			message_header<T> header{};
+		};
+
+		// A message read back out of a capture
+		template <typename T>
+		struct capture_record
+		{
+			int64_t nTimestamp = 0;
+			uint32_t nConnectionID = 0;
+			message<T> msg;
+		};
+
+		// Records the messages a server dispatches, exactly as its OnMessage sees them.
+		// Not thread safe - it is meant to be driven from the thread calling Update()
+		template <typename T>
+		class capture_writer
+		{
+		public:
+			capture_writer(const std::string& sPath, size_t nSegmentSize)
+				: m_log(sPath, nSegmentSize)
+			{
+
+			}
+
+		public:
+			void Record(uint32_t nConnectionID, const message<T>& msg)
+			{
+				capture_record_header<T> record;
+				record.nTimestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+				record.nConnectionID = nConnectionID;
+				record.header = msg.header;
+
+				if (m_log.Append(&record, sizeof(record), msg.body.data(), msg.body.size()))
+					m_nRecorded++;
+				else
+					m_nDropped++;
+			}
+
+			void Flush()
+			{
+				m_log.Flush();
+			}
+
+			// Number of messages written, and number too large to fit in a segment
+			size_t RecordedCount() const { return m_nRecorded; }
+			size_t DroppedCount() const { return m_nDropped; }
+
+		protected:
+			mapped_log_writer m_log;
+			size_t m_nRecorded = 0;
+			size_t m_nDropped = 0;
+		};
+
+		// Reads a capture back one message at a time
+		template <typename T>
+		class capture_reader
+		{
+		public:
+			capture_reader(const std::string& sPath)
+				: m_log(sPath)
+			{
+
+			}
+
+		public:
+			// Fills in the next captured message, reusing the body's storage.
+			// Returns false at the end of the capture
+			bool Next(capture_record<T>& record)
+			{
+				const uint8_t* pRecord = nullptr;
+				size_t nSize = 0;
+
+				while (m_log.Next(pRecord, nSize))
+				{
+					// Skip anything too short to be one of ours
+					if (nSize < sizeof(capture_record_header<T>))
+						continue;
+
+					capture_record_header<T> header;
+					std::memcpy(&header, pRecord, sizeof(header));
+
+					record.nTimestamp = header.nTimestamp;
+					record.nConnectionID = header.nConnectionID;
+					record.msg.header = header.header;
+					record.msg.body.assign(pRecord + sizeof(header), pRecord + nSize);
+					return true;
+				}
+				return false;
+			}
+
+		protected:
+			mapped_log_reader m_log;
+		};
+	}
+}
@@ -4,11 +4,22 @@
 #include "NetMessage.h"
 #include "net_tsqueue.h"
 #include "net_connection.h"
+#include "net_trace.h"
+#include "net_tls.h"
+#include "net_fixed.h"
+#include "net_run_mode.h"
 
 namespace olc
 {
 	namespace net
 	{
+		// How a client with several connections to the same server spreads its messages
+		enum class stripe_mode
+		{
+			affinity,		// Keyed messages always take the same stream, so their order is kept
+			round_robin		// Every message takes the next stream in turn
+		};
+
 		template<typename T>
 		class client_interface
 		{
@@ -20,27 +31,94 @@ namespace olc
 				Disconnect();
 			}
 		public:
-			// Connect to server with hostname/ip-address and port
-			bool Connect(const std::string& host, const uint16_t port)
+			// Connect to server with hostname/ip-address and port. With nStreams > 1, that many
+			// connections are opened to the same server and outgoing messages are spread across
+			// them according to nMode. They all share one context thread and one incoming queue.
+			// The streams tell the server they are one client: the extra ones only connect once
+			// the first has validated, and the server gives them all its ID
+			bool Connect(const std::string& host, const uint16_t port, size_t nStreams = 1, stripe_mode nMode = stripe_mode::affinity)
 			{
+#if defined(OLC_NET_IO_URING) && defined(__linux__)
+				if (!io_uring_available())
+				{
+					std::cerr << "Client Exception: built with OLC_NET_IO_URING, but io_uring can't be set up here\n";
+					return false;
+				}
+#endif
 				try
 				{
+					// Connecting again after a Disconnect(), so let the old streams finish closing
+					// before they are replaced. This is where a TLS client gets to resume its session
+					if (m_context.stopped())
+					{
+						m_context.restart();
+						if (m_connection)
+							m_connection->Disconnect();
+						for (auto& stripe : m_vStripes)
+							stripe->Disconnect();
+						m_context.poll();
+						m_context.restart();
+					}
 
 					// Resolve hostname/ip-address into tangiable physical address
 					boost::asio::ip::tcp::resolver resolver(m_context);
 					auto endpoints = resolver.resolve(host, std::to_string(port));
 
-					// Create Connection
-					m_connection = std::make_unique<connection<T>>(
-						connection<T>::owner::client,
-						m_context,
-						boost::asio::ip::tcp::socket(m_context),
-						m_qMessagesIn);
+					m_nStripeMode = nMode;
+					m_vStripes.clear();
+
+					// Coming back after a drop, so present the token the server gave the last
+					// primary stream, and carry on with the features agreed on then
+					resume_token token;
+					uint32_t nResumeFeatures = 0;
+					if (m_connection && (m_nFeatures & FEATURE_RESUME))
+					{
+						token = m_connection->GetResumeToken();
+						nResumeFeatures = m_connection->GetFeatures();
+					}
+
+					bool bStriped = nStreams > 1;
+
+					for (size_t i = 0; i < std::max(nStreams, size_t(1)); i++)
+					{
+						// Create Connection
+						auto conn = std::make_unique<connection<T>>(
+							connection<T>::owner::client,
+							m_context,
+							boost::asio::ip::tcp::socket(m_context),
+							m_qMessagesIn);
 
+						conn->RequestFeatures(bStriped ? (m_nFeatures | FEATURE_STRIPE) : m_nFeatures);
+						conn->SetTracer(m_pTracer);
+						conn->SetFixedLayout(m_pFixedLayout);
+						conn->SetSocketTuning(m_pSocketTuning);
+						if (i == 0 && !token.empty())
+							conn->PresentResumeToken(token, nResumeFeatures);
+#ifdef OLC_NET_TLS
+						if (m_pTLSContext)
+							conn->EnableTLS(*m_pTLSContext, m_pTLSSessions, host, m_bTLSVerify);
+#endif
+						// The first stream is the primary connection, any others are extra stripes
+						if (i == 0)
+							m_connection = std::move(conn);
+						else
+							m_vStripes.push_back(std::move(conn));
+					}
+
+					// Stripes wait for the primary, as they join the group the server issues it
+					m_connection->SetValidatedHandler(
+						[this, endpoints]()
+						{
+							for (auto& stripe : m_vStripes)
+							{
+								stripe->SetStripeGroup(m_connection->GetStripeGroup());
+								stripe->ConnectToServer(endpoints);
+							}
+						});
 					m_connection->ConnectToServer(endpoints);
 
 					thrContext = std::thread(
-						[this]() {m_context.run(); }
+						[this]() { run_context(m_context, m_runMode); }
 					);
 				}
 				catch (const std::exception& e)
@@ -54,41 +132,219 @@ namespace olc
 			void Disconnect()
 			{
 				// If connection exissts, and it's connected then...
-				if (IsConnected())
+				if (m_connection && m_connection->IsConnected())
 				{
 					// ...disconnect from server gracefully
 					m_connection->Disconnect();
 				}
+				for (auto& stripe : m_vStripes)
+					stripe->Disconnect();
+
 				// Either way, we're also done with the asio context...
 				m_context.stop();
 				if (thrContext.joinable())
 					thrContext.join();
 			}
-			// Check if client is actually connected to a server
-			bool IsConnected()
+			// Ask the server for per-frame CRC32C checksums, must be called before Connect()
+			void EnableChecksums(bool bEnable)
 			{
-				if (m_connection)
-					return m_connection->IsConnected();
+				if (bEnable)
+					m_nFeatures |= FEATURE_CHECKSUM;
 				else
-					return false;
+					m_nFeatures &= ~FEATURE_CHECKSUM;
+			}
+			// Tune the socket of every stream for the kind of traffic it will carry, see
+			// socket_profile. Must be called before Connect()
+			void SetSocketProfile(socket_profile nProfile)
+			{
+				SetSocketTuning(socket_tuning::For(nProfile));
+			}
+			void SetSocketTuning(const socket_tuning& tuning)
+			{
+				m_pSocketTuning = std::make_shared<const socket_tuning>(tuning);
+			}
+			// Choose how the context thread waits for work, and which cores it runs on, see
+			// run_mode. Call before Connect(). Incoming().wait() can spin the same way, by
+			// passing it tSpinBeforePark
+			void SetRunMode(const run_mode& mode)
+			{
+				m_runMode = mode;
+			}
+			// What the primary stream's socket options came to, see socket_report
+			socket_report GetSocketReport()
+			{
+				return m_connection ? m_connection->GetSocketReport() : socket_report{};
+			}
+			// Ask the server for a resume_token, must be called before Connect(). A later Connect()
+			// after a drop then presents it, and picks up as the same client (same ID) without
+			// waiting on validation. If the server refuses the token, the connection closes, and
+			// the Connect() after that validates afresh
+			void EnableResumption(bool bEnable)
+			{
+				if (bEnable)
+					m_nFeatures |= FEATURE_RESUME;
+				else
+					m_nFeatures &= ~FEATURE_RESUME;
+			}
+			// True if the primary stream took over the previous one's place with its token
+			bool IsResumed()
+			{
+				return m_connection && m_connection->IsResumed();
+			}
+#ifdef OLC_NET_TLS
+			// Talk to the server over TLS, must be called before Connect(). The server's certificate
+			// must chain to one of the CA certificates in sCAFile, or to the system's own if it is
+			// empty, and be issued for the host passed to Connect().
+			// Sessions are remembered, so reconnecting (and every stream after the first) resumes
+			// rather than doing a full handshake
+			bool EnableTLS(const std::string& sCAFile = "")
+			{
+				return CreateTLSContext(sCAFile, true);
+			}
+
+			// TLS without checking who the server is: the link is encrypted, but anyone in the
+			// middle can stand in for the server. Only for testing against throwaway certificates
+			bool EnableInsecureTLS()
+			{
+				std::cerr << "[CLIENT] TLS server certificate will NOT be verified\n";
+				return CreateTLSContext("", false);
+			}
+#endif
+			// Sample one in every nSampleEvery messages, in and out, and time each stage they pass
+			// through. Must be called before Connect(). See DumpTrace()
+			void EnableTracing(size_t nSampleEvery = 100, size_t nCapacity = 65536)
+			{
+				m_pTracer = std::make_shared<message_tracer>(nSampleEvery, nCapacity);
+			}
+			// Drop the connection if the server sends one of these fixed layout messages (see
+			// fixed_payload) with a body of any other size. Must be called before Connect()
+			template<auto... IDs>
+			void DeclareFixedPayloads()
+			{
+				m_pFixedLayout = fixed_layout<T>::template Of<IDs...>();
+			}
+			// Write the most recent traced stages to sPath, for chrome://tracing or ui.perfetto.dev
+			bool DumpTrace(const std::string& sPath)
+			{
+				return m_pTracer && m_pTracer->Dump(sPath);
+			}
+
+			// Check if client is actually connected to a server, on any of its streams
+			bool IsConnected()
+			{
+				return SelectStream(0) != nullptr;
 			}
 		public:
-			void Send(const message<T>& msg)
+			// With several streams, round robin mode spreads these across all of them, while
+			// affinity mode keeps unkeyed messages on one stream, in order
+			void Send(message<T> msg, priority nPriority = priority::normal)
+			{
+				size_t nHint = m_nStripeMode == stripe_mode::round_robin ? m_nNextStream++ : 0;
+				if (auto conn = SelectStream(nHint))
+					conn->Send(std::move(msg), nPriority);
+			}
+			// Messages with the same key take the same stream, so they arrive in the order sent
+			void Send(uint64_t nKey, message<T> msg, priority nPriority = priority::normal)
 			{
-				if (IsConnected())
-					m_connection->Send(msg);
+				if (auto conn = SelectStream(nKey))
+					conn->Send(std::move(msg), nPriority);
+			}
+			// Send a message that replaces any still waiting to go with the same key
+			void SendConflated(uint64_t nKey, message<T> msg, priority nPriority = priority::normal)
+			{
+				if (auto conn = SelectStream(nKey))
+					conn->SendConflated(nKey, std::move(msg), nPriority);
 			}
 			// Retrieve queue of messges from server
 			tsqueue<owned_message<T>>& Incoming()
 			{
 				return m_qMessagesIn;
 			}
+			// Number of streams to the server, connected or not
+			size_t StreamCount() const
+			{
+				return m_connection ? 1 + m_vStripes.size() : 0;
+			}
+		private:
+			// Picks the stream for nHint, or the next one along that is still connected if that one
+			// has failed. Keys on a failed stream move to another, so ordering is only kept per stream
+			connection<T>* SelectStream(size_t nHint)
+			{
+				size_t nStreams = StreamCount();
+				for (size_t i = 0; i < nStreams; i++)
+				{
+					size_t nStream = (nHint + i) % nStreams;
+					connection<T>* conn = nStream == 0 ? m_connection.get() : m_vStripes[nStream - 1].get();
+					if (conn->IsConnected())
+						return conn;
+				}
+				return nullptr;
+			}
+#ifdef OLC_NET_TLS
+			bool CreateTLSContext(const std::string& sCAFile, bool bVerify)
+			{
+				try
+				{
+					auto ctx = std::make_unique<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client);
+					ctx->set_options(boost::asio::ssl::context::default_workarounds |
+						boost::asio::ssl::context::no_sslv2 | boost::asio::ssl::context::no_sslv3 |
+						boost::asio::ssl::context::no_tlsv1 | boost::asio::ssl::context::no_tlsv1_1);
+					if (bVerify)
+					{
+						if (sCAFile.empty())
+							ctx->set_default_verify_paths();
+						else
+							ctx->load_verify_file(sCAFile);
+						ctx->set_verify_mode(boost::asio::ssl::verify_peer);
+					}
+					else
+						ctx->set_verify_mode(boost::asio::ssl::verify_none);
+
+					if (!m_pTLSSessions)
+						m_pTLSSessions = std::make_shared<tls_session_cache>();
+					m_pTLSSessions->Attach(*ctx);
+					m_pTLSContext = std::move(ctx);
+					m_bTLSVerify = bVerify;
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "Client TLS Exception: " << e.what() << "\n";
+					return false;
+				}
+				return true;
+			}
+#endif
 		protected:
 			boost::asio::io_context m_context;
 			std::thread thrContext;
+			run_mode m_runMode;
 			std::unique_ptr<connection<T>> m_connection;
+
+			// Extra connections to the same server, when striping over several streams
+			std::vector<std::unique_ptr<connection<T>>> m_vStripes;
+			stripe_mode m_nStripeMode = stripe_mode::affinity;
+			std::atomic<size_t> m_nNextStream = 0;
 		private:
 			tsqueue<owned_message<T>> m_qMessagesIn;
+
+			// Optional features to ask the server for
+			uint32_t m_nFeatures = 0;
+
+			// Optional sampling of per-stage message timings
+			std::shared_ptr<message_tracer> m_pTracer;
+
+			// Options for every stream's socket, if any
+			std::shared_ptr<const socket_tuning> m_pSocketTuning;
+
+			// Sizes of the fixed layout messages the server may send, if declared
+			std::shared_ptr<const fixed_layout<T>> m_pFixedLayout;
+
+#ifdef OLC_NET_TLS
+			// TLS settings for every stream, and the session they resume from
+			std::unique_ptr<boost::asio::ssl::context> m_pTLSContext;
+			std::shared_ptr<tls_session_cache> m_pTLSSessions;
+			bool m_bTLSVerify = true;
+#endif
 		};
 	}
 }
\ No newline at end of file
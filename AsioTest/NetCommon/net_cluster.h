@@ -0,0 +1,405 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "net_tsqueue.h"
+#include "NetMessage.h"
+#include "net_connection.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// Client IDs carry the ID of the node they are connected to in their top 8 bits,
+		// so they are unique across the whole cluster and say where to route to
+		constexpr uint32_t CLUSTER_NODE_SHIFT = 24;
+
+		inline uint8_t NodeOfClient(uint32_t nClientID)
+		{
+			return uint8_t(nClientID >> CLUSTER_NODE_SHIFT);
+		}
+
+		// Frames on a peer link. Links are never seen by OnMessage, so these share the
+		// message ID space with the application's own IDs without clashing
+		enum class cluster_op : uint32_t
+		{
+			hello,		// uint32 node ID, sent by both ends as soon as the link is up
+			direct,		// uint32 client ID, then one relayed message
+			broadcast	// Any number of relayed messages, for every client on the receiving node
+		};
+
+		// Links one server_interface to the other servers in a cluster. Every node listens for
+		// peers on its own peer port, and dials those given to Connect(). Nodes expect to be
+		// fully meshed: each node reaches every other one directly, and relayed traffic is
+		// never forwarded on again.
+		//
+		// Anything arriving over a peer link is trusted, so the peer port only takes links from
+		// the addresses it has been told about: those given to AllowPeer(), and those dialed
+		// with Connect(). Everyone else is disconnected as soon as they are accepted.
+		//
+		// A link that drops is forgotten, and traffic for its node is dropped until the node is
+		// linked again. Whichever end dialed redials, backing off from DIAL_BACKOFF_MIN up to
+		// DIAL_BACKOFF_MAX between attempts until the other end says hello.
+		//
+		// Peer links are ordinary connections, with the server's context and incoming queue, and
+		// are told apart by FEATURE_PEER. Relayed messages are wrapped as:
+		//     [uint32 priority][message_header<T>][body]
+		// Broadcasts are gathered up and go out to each peer as one frame per Flush()
+		template<typename T>
+		class cluster_node
+		{
+		public:
+			cluster_node(boost::asio::io_context& asioContext, tsqueue<owned_message<T>>& qIn, uint8_t nNodeID, uint16_t nPeerPort)
+				: m_asioContext(asioContext), m_qMessagesIn(qIn), m_nNodeID(nNodeID),
+				m_asioAcceptor(asioContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), nPeerPort)),
+				m_timerLinks(asioContext)
+			{
+				m_msgBroadcast.header.id = T(cluster_op::broadcast);
+			}
+
+		public:
+			uint8_t GetNodeID() const
+			{
+				return m_nNodeID;
+			}
+
+			// Start listening for peers dialing in, and watching for links that drop
+			void Start()
+			{
+				WaitForPeerConnection();
+				WatchLinks();
+			}
+
+			// Dial a peer. The link is usable once both ends have said hello
+			bool Connect(const std::string& host, const uint16_t port)
+			{
+				try
+				{
+					boost::asio::ip::tcp::resolver resolver(m_asioContext);
+					auto endpoints = resolver.resolve(host, std::to_string(port));
+
+					// A node we dial may just as well be the one to dial us
+					for (auto& endpoint : endpoints)
+						AllowPeer(endpoint.endpoint().address());
+
+					peer_dial dial;
+					dial.sPeer = host + ":" + std::to_string(port);
+					dial.endpoints = endpoints;
+					dial.link = Dial(endpoints);
+					dial.tBackoff = DIAL_BACKOFF_MIN;
+
+					std::scoped_lock lock(muxLinks);
+					m_vDials.push_back(std::move(dial));
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "[CLUSTER] Connect Exception: " << e.what() << "\n";
+					return false;
+				}
+				return true;
+			}
+
+			// Accept peer links from address
+			void AllowPeer(const boost::asio::ip::address& address)
+			{
+				std::scoped_lock lock(muxLinks);
+				m_setAllowed.insert(AddressKey(address));
+			}
+
+			// True if this message came in over a peer link rather than from a client
+			static bool IsPeer(const std::shared_ptr<connection<T>>& remote)
+			{
+				return remote && (remote->GetFeatures() & FEATURE_PEER);
+			}
+
+			// Send a message to a client on another node. Dropped if that node isn't linked, as
+			// while its link is down
+			void Relay(uint32_t nClientID, const message<T>& msg, priority nPriority)
+			{
+				auto it = m_mapNodes.find(NodeOfClient(nClientID));
+				if (it == m_mapNodes.end() || !it->second->IsConnected())
+					return;
+
+				message<T> msgOut;
+				msgOut.header.id = T(cluster_op::direct);
+				Append(msgOut, &nClientID, sizeof(nClientID));
+				Wrap(msgOut, msg, nPriority);
+				it->second->Send(std::move(msgOut), nPriority);
+			}
+
+			// Add a message to the batch going to every client on every other node
+			void QueueBroadcast(const message<T>& msg, priority nPriority)
+			{
+				Wrap(m_msgBroadcast, msg, nPriority);
+
+				// Don't let one batch grow without bound
+				if (m_msgBroadcast.body.size() >= MAX_BATCH_BYTES)
+					Flush();
+			}
+
+			// Send the batch of broadcasts to every linked node
+			void Flush()
+			{
+				DropLostNodes();
+
+				if (m_msgBroadcast.body.empty())
+					return;
+
+				m_msgBroadcast.header.size = uint32_t(m_msgBroadcast.body.size());
+				for (auto& [nNode, link] : m_mapNodes)
+					if (link->IsConnected())
+						link->Send(m_msgBroadcast);
+
+				m_msgBroadcast.body.clear();
+			}
+
+			// Handle a frame from a peer link. Relayed messages are unwrapped and handed to
+			// deliver(nClientID, msg, priority), with a client ID of 0 meaning every local client
+			template<typename F>
+			void Receive(const std::shared_ptr<connection<T>>& link, message<T>& msg, F&& deliver)
+			{
+				size_t nOffset = 0;
+				switch (cluster_op(msg.header.id))
+				{
+				case cluster_op::hello:
+				{
+					uint32_t nNode = 0;
+					if (Extract(msg, nOffset, &nNode, sizeof(nNode)))
+					{
+						m_mapNodes[uint8_t(nNode)] = link;
+						std::cout << "[CLUSTER] Linked to node " << nNode << "\n";
+
+						// The link works, so should it drop, start redialing it promptly
+						std::scoped_lock lock(muxLinks);
+						for (auto& dial : m_vDials)
+							if (dial.link == link)
+								dial.tBackoff = DIAL_BACKOFF_MIN;
+					}
+				}
+				break;
+				case cluster_op::direct:
+				{
+					uint32_t nClientID = 0;
+					message<T> msgInner;
+					priority nPriority;
+					if (!Extract(msg, nOffset, &nClientID, sizeof(nClientID)))
+						break;
+
+					// Only ever sent to the client's own node, and never passed on from here
+					if (NodeOfClient(nClientID) != m_nNodeID)
+						break;
+
+					if (Unwrap(msg, nOffset, msgInner, nPriority))
+						deliver(nClientID, msgInner, nPriority);
+				}
+				break;
+				case cluster_op::broadcast:
+				{
+					message<T> msgInner;
+					priority nPriority;
+					while (nOffset < msg.body.size() && Unwrap(msg, nOffset, msgInner, nPriority))
+						deliver(0, msgInner, nPriority);
+				}
+				break;
+				}
+			}
+
+		private:
+			std::shared_ptr<connection<T>> Dial(const boost::asio::ip::tcp::resolver::results_type& endpoints)
+			{
+				auto link = std::make_shared<connection<T>>(connection<T>::owner::client,
+					m_asioContext, boost::asio::ip::tcp::socket(m_asioContext), m_qMessagesIn);
+				link->RequestFeatures(FEATURE_PEER);
+				link->ConnectToServer(endpoints);
+				SayHello(link);
+				return link;
+			}
+
+			// Async - Every LINK_CHECK_EVERY, forget accepted links that have gone, as their
+			// node will dial in again, and redial the peers we dialed whose links have gone
+			void WatchLinks()
+			{
+				m_timerLinks.expires_after(LINK_CHECK_EVERY);
+				m_timerLinks.async_wait(
+					[this](std::error_code ec)
+					{
+						if (ec)
+							return;
+
+						{
+							std::scoped_lock lock(muxLinks);
+							std::erase_if(m_vLinks, [](const auto& link) { return !link->IsConnected(); });
+
+							auto tNow = std::chrono::steady_clock::now();
+							for (auto& dial : m_vDials)
+							{
+								if (dial.link->IsConnected() || tNow < dial.tNextDial)
+									continue;
+
+								std::cout << "[CLUSTER] Redialing " << dial.sPeer << "\n";
+								dial.link = Dial(dial.endpoints);
+								dial.tNextDial = tNow + dial.tBackoff;
+								dial.tBackoff = std::min(dial.tBackoff * 2, DIAL_BACKOFF_MAX);
+							}
+						}
+
+						WatchLinks();
+					});
+			}
+
+			// Forget the nodes whose links have dropped, so nothing more is sent down them
+			void DropLostNodes()
+			{
+				std::erase_if(m_mapNodes,
+					[](const auto& entry)
+					{
+						if (entry.second->IsConnected())
+							return false;
+						std::cout << "[CLUSTER] Lost node " << int(entry.first) << "\n";
+						return true;
+					});
+			}
+
+			// Async - wait for a peer to dial in
+			void WaitForPeerConnection()
+			{
+				m_asioAcceptor.async_accept(
+					[this](std::error_code ec, boost::asio::ip::tcp::socket socket)
+					{
+						if (!ec && !Allowed(socket))
+						{
+							boost::system::error_code ecClose;
+							std::cout << "[CLUSTER] Refused Peer: " << socket.remote_endpoint(ecClose) << "\n";
+							socket.close(ecClose);
+						}
+						else if (!ec)
+						{
+							std::cout << "[CLUSTER] New Peer: " << socket.remote_endpoint() << "\n";
+
+							auto link = std::make_shared<connection<T>>(connection<T>::owner::server,
+								m_asioContext, std::move(socket), m_qMessagesIn);
+							link->RequestFeatures(FEATURE_PEER);
+							link->ConnectToClient(nullptr);
+							SayHello(link);
+
+							std::scoped_lock lock(muxLinks);
+							m_vLinks.push_back(std::move(link));
+						}
+						else
+						{
+							std::cout << "[CLUSTER] New Peer Error: " << ec.message() << "\n";
+						}
+
+						WaitForPeerConnection();
+					});
+			}
+
+			bool Allowed(const boost::asio::ip::tcp::socket& socket)
+			{
+				boost::system::error_code ec;
+				auto endpoint = socket.remote_endpoint(ec);
+				if (ec)
+					return false;
+
+				std::scoped_lock lock(muxLinks);
+				return m_setAllowed.count(AddressKey(endpoint.address())) > 0;
+			}
+
+			// An IPv4 peer may turn up as an IPv4-mapped IPv6 address, so compare those as IPv4
+			static std::string AddressKey(const boost::asio::ip::address& address)
+			{
+				if (address.is_v6() && address.to_v6().is_v4_mapped())
+					return boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, address.to_v6()).to_string();
+				return address.to_string();
+			}
+
+			void SayHello(const std::shared_ptr<connection<T>>& link)
+			{
+				message<T> msg;
+				msg.header.id = T(cluster_op::hello);
+				uint32_t nNode = m_nNodeID;
+				Append(msg, &nNode, sizeof(nNode));
+				link->Send(msg, priority::control);
+			}
+
+			static void Append(message<T>& msg, const void* pData, size_t nBytes)
+			{
+				size_t i = msg.body.size();
+				msg.body.resize(i + nBytes);
+				std::memcpy(msg.body.data() + i, pData, nBytes);
+				msg.header.size = uint32_t(msg.body.size());
+			}
+
+			static bool Extract(const message<T>& msg, size_t& nOffset, void* pData, size_t nBytes)
+			{
+				if (msg.body.size() - nOffset < nBytes)
+					return false;
+				std::memcpy(pData, msg.body.data() + nOffset, nBytes);
+				nOffset += nBytes;
+				return true;
+			}
+
+			static void Wrap(message<T>& msgOut, const message<T>& msg, priority nPriority)
+			{
+				uint32_t nPrio = uint32_t(nPriority);
+				message_header<T> header = msg.header;
+				header.size = uint32_t(msg.body.size());
+				header.checksum = 0;
+				Append(msgOut, &nPrio, sizeof(nPrio));
+				Append(msgOut, &header, sizeof(header));
+				Append(msgOut, msg.body.data(), msg.body.size());
+			}
+
+			static bool Unwrap(const message<T>& msg, size_t& nOffset, message<T>& msgInner, priority& nPriority)
+			{
+				uint32_t nPrio = 0;
+				if (!Extract(msg, nOffset, &nPrio, sizeof(nPrio)) || nPrio >= PRIORITY_LANES ||
+					!Extract(msg, nOffset, &msgInner.header, sizeof(msgInner.header)))
+					return false;
+
+				// The size comes from the peer, so make sure the frame holds that much before
+				// allocating for it
+				if (msgInner.header.size > msg.body.size() - nOffset)
+					return false;
+
+				msgInner.body.resize(msgInner.header.size);
+				nPriority = priority(nPrio);
+				return Extract(msg, nOffset, msgInner.body.data(), msgInner.body.size());
+			}
+
+		private:
+			// A peer given to Connect(), which is redialed whenever its link drops
+			struct peer_dial
+			{
+				std::string sPeer;
+				boost::asio::ip::tcp::resolver::results_type endpoints;
+				std::shared_ptr<connection<T>> link;
+				std::chrono::steady_clock::duration tBackoff{};
+				std::chrono::steady_clock::time_point tNextDial{};
+			};
+
+			static constexpr size_t MAX_BATCH_BYTES = 256 * 1024;
+			static constexpr std::chrono::milliseconds LINK_CHECK_EVERY{ 250 };
+			static constexpr std::chrono::steady_clock::duration DIAL_BACKOFF_MIN = std::chrono::milliseconds(250);
+			static constexpr std::chrono::steady_clock::duration DIAL_BACKOFF_MAX = std::chrono::seconds(30);
+
+			boost::asio::io_context& m_asioContext;
+			tsqueue<owned_message<T>>& m_qMessagesIn;
+			uint8_t m_nNodeID = 0;
+			boost::asio::ip::tcp::acceptor m_asioAcceptor;
+			boost::asio::steady_timer m_timerLinks;
+
+			// Links accepted, peers dialed, and the addresses links may be accepted from.
+			// Guarded as accepts and link checks run on the context thread
+			std::mutex muxLinks;
+			std::vector<std::shared_ptr<connection<T>>> m_vLinks;
+			std::vector<peer_dial> m_vDials;
+			std::unordered_set<std::string> m_setAllowed;
+
+			// Links that have said hello, by node. Only touched from the Update() thread
+			std::unordered_map<uint8_t, std::shared_ptr<connection<T>>> m_mapNodes;
+
+			// Broadcasts waiting for the next Flush()
+			message<T> m_msgBroadcast;
+		};
+	}
+}
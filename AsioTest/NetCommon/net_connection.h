@@ -3,6 +3,16 @@
 #include "NetCommon.h"
 #include "net_tsqueue.h"
 #include "NetMessage.h"
+#include "net_crc32c.h"
+#include "net_outqueue.h"
+#include "net_trace.h"
+#include "net_tls.h"
+#include "net_file.h"
+#include "net_ratelimit.h"
+#include "net_body_pool.h"
+#include "net_fixed.h"
+#include "net_resume.h"
+#include "net_socket_tuning.h"
 
 namespace olc
 {
@@ -12,6 +22,27 @@ namespace olc
 		template<typename T>
 		class server_interface;
 
+		// Optional features, agreed on during validation. Each side asks for the features it
+		// wants, and a feature is only switched on when both sides asked for it
+		constexpr uint32_t FEATURE_CHECKSUM = 1u << 0;	// CRC32C of every frame, carried in its header
+		constexpr uint32_t FEATURE_PEER = 1u << 1;		// Link between two cluster nodes, see cluster_node
+		constexpr uint32_t FEATURE_RESUME = 1u << 2;	// Server issues a resume_token after validation
+		constexpr uint32_t FEATURE_RESUMING = 1u << 3;	// Client presents a token instead of solving the puzzle
+		constexpr uint32_t FEATURE_STRIPE = 1u << 4;	// Stream belongs to a stripe group the server issues
+
+		// The streams of one striped client, as the server sees them. The client's primary
+		// stream asks for a new group and leads it, and the server answers with the group's ID,
+		// drawn from secure_random(). The client's other streams present that ID, and take on
+		// the leader's ID and share its rate limit, so the server deals with one client however
+		// many streams it has. The ID is all it takes to join, so like a resume token it is
+		// only ever issued by the server, and it travels in the clear unless TLS is on
+		template<typename T>
+		struct stripe_group
+		{
+			uint32_t nClientID = 0;
+			std::shared_ptr<rate_limiter<T>> pLimiter;
+		};
+
 		template<typename T>
 		class connection : public std::enable_shared_from_this<connection<T>>
 		{
@@ -23,25 +54,12 @@ namespace olc
 			};
 
 			connection(owner parent, boost::asio::io_context& asioContext, boost::asio::ip::tcp::socket socket, tsqueue<owned_message<T>>& qIn)
-				:m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn)
+				:m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn), m_timerLimit(asioContext), m_timerTuning(asioContext)
 			{
 				m_nOwnerType = parent;
 
 				// Construct validation check data
-				if (m_nOwnerType == owner::server)
-				{
-					// Connection is Server -> Client,
-					// Construct random data for the client to transform ans send back for validation
-					m_nHandshakeOut = uint64_t(std::chrono::system_clock::now().time_since_epoch().count());
-
-					// Pre-calculate the result for checking when the client responds
-					m_nHandshakeCheck = scramble(m_nHandshakeOut);
-				}
-				else
-				{
-					m_nHandshakeIn = 0;
-					m_nHandshakeOut = 0;
-				}
+				PrepareHandshake();
 			}
 
 
@@ -53,6 +71,247 @@ namespace olc
 				return id;
 			}
 
+			// Ask for optional features, must be called before the connection is validated
+			void RequestFeatures(uint32_t nFeatures)
+			{
+				m_nFeaturesOut = nFeatures;
+			}
+
+			// The features both sides agreed on during validation
+			uint32_t GetFeatures() const
+			{
+				return m_nFeatures;
+			}
+
+			// Sample messages through this connection into tracer, or pass nullptr to stop
+			void SetTracer(std::shared_ptr<message_tracer> tracer)
+			{
+				m_pTracer = std::move(tracer);
+			}
+
+			// Hold incoming messages to limit, or pass nullptr to lift it. Checked as each header
+			// arrives, before anything is allocated for the body. Call before connecting
+			void SetRateLimit(std::shared_ptr<const rate_limit<T>> limit)
+			{
+				if (limit)
+					m_pLimiter = std::make_shared<rate_limiter<T>>(std::move(limit));
+				else
+					m_pLimiter.reset();
+			}
+
+			// Have this stream join nGroup, which the server issued to the client's primary
+			// stream (see GetStripeGroup()), rather than start a new group. Call before connecting
+			void SetStripeGroup(uint64_t nGroup)
+			{
+				m_nStripeGroup = nGroup;
+			}
+
+			// The group this stream belongs to, 0 if the client isn't striping or the server
+			// hasn't said yet
+			uint64_t GetStripeGroup() const
+			{
+				return m_nStripeGroup;
+			}
+
+			// Call fn once this (client) connection has validated, or resumed, or pass nullptr.
+			// Called from the context thread
+			void SetValidatedHandler(std::function<void()> fn)
+			{
+				m_fnOnValidated = std::move(fn);
+			}
+
+			// Take buffers for incoming bodies from pool, once the last one has been handed on
+			// with its message. Call before connecting
+			void SetBodyPool(std::shared_ptr<body_pool> pool)
+			{
+				m_pBodyPool = std::move(pool);
+			}
+
+			// Refuse frames whose size doesn't match the fixed layout declared for their ID, or
+			// pass nullptr to accept any size. Call before connecting
+			void SetFixedLayout(std::shared_ptr<const fixed_layout<T>> layout)
+			{
+				m_pFixedLayout = std::move(layout);
+			}
+
+			// Messages that arrived over the rate limit, whether held back, dropped or refused
+			uint64_t GetRateLimited() const
+			{
+				return m_nRateLimited;
+			}
+
+			// Let clients come back with tokens from table, or pass nullptr. Call before connecting
+			void SetResumeTable(std::shared_ptr<resume_table<T>> table)
+			{
+				m_pResume = std::move(table);
+			}
+
+			// Present token, and the features agreed on along with it, in place of validating.
+			// The connection is usable as soon as it connects, with no round trip to wait for.
+			// Call before connecting
+			void PresentResumeToken(const resume_token& token, uint32_t nFeatures)
+			{
+				m_resumeToken = token;
+				m_nFeatures = nFeatures;
+			}
+
+			// The token the server issued to this connection, empty if it hasn't
+			const resume_token& GetResumeToken() const
+			{
+				return m_resumeToken;
+			}
+
+			// True if this connection took over from an earlier one with a resume_token
+			bool IsResumed() const
+			{
+				return m_bResumed;
+			}
+
+			// Apply tuning to the socket as soon as it connects, or pass nullptr to leave it as
+			// the OS has it. Call before connecting
+			void SetSocketTuning(std::shared_ptr<const socket_tuning> tuning)
+			{
+				m_pTuning = std::move(tuning);
+			}
+
+			// What the socket's options are in effect, and how the link looked when last measured
+			socket_report GetSocketReport()
+			{
+				return m_tuner.Report();
+			}
+
+			// The identity the server tied this client to, which outlives the connection, or 0
+			uint64_t GetIdentity() const
+			{
+				return m_nIdentity;
+			}
+
+			// Call fn whenever the last queued message has been written, or pass nullptr to stop.
+			// Call from the context thread
+			void SetDrainHandler(std::function<void()> fn)
+			{
+				m_fnOnDrained = std::move(fn);
+			}
+
+			// Hand every message that was never written to fn(message, priority), leaving the
+			// queue empty. Only once the connection has closed, and from the context thread.
+			// Messages with a file region can't be handed on without the file, and are dropped.
+			// The message being written when the link closed is handed on too: the remote threw
+			// away whatever part of it arrived, unless all of it did, so it may be seen twice.
+			// Under TLS the frames in the record being written have already left the queue, and
+			// are not handed on, so the remote may be missing some or all of those
+			template<typename F>
+			void TakeUnsent(F&& fn)
+			{
+				if (IsConnected())
+					return;
+
+				m_qMessagesOut.drain(std::forward<F>(fn));
+				m_fileOut = {};
+			}
+
+#ifdef OLC_NET_TLS
+			// Run this connection over TLS, using ctx, which must outlive it. Call before connecting.
+			// Clients can pass a session cache, to resume an earlier session instead of doing a
+			// full handshake, and the host they dialed. The host is sent as SNI, and unless
+			// bVerifyHost is false the server's certificate must be issued for it
+			void EnableTLS(boost::asio::ssl::context& ctx, std::shared_ptr<tls_session_cache> sessions = nullptr,
+				const std::string& sHost = "", bool bVerifyHost = true)
+			{
+				m_pTLSSessions = std::move(sessions);
+				m_pTLS = std::make_unique<boost::asio::ssl::stream<boost::asio::ip::tcp::socket&>>(m_socket, ctx);
+				if (sHost.empty())
+					return;
+
+				// SNI only carries names, never addresses
+				boost::system::error_code ec;
+				boost::asio::ip::make_address(sHost, ec);
+				if (ec)
+					SSL_set_tlsext_host_name(m_pTLS->native_handle(), sHost.c_str());
+
+				if (bVerifyHost)
+					m_pTLS->set_verify_callback(boost::asio::ssl::host_name_verification(sHost));
+			}
+
+			// True if the TLS handshake resumed an earlier session
+			bool IsTLSResumed()
+			{
+				return m_pTLS && SSL_session_reused(m_pTLS->native_handle());
+			}
+#endif
+
+			// Pooled connections are constructed long before they are given a socket, so let them
+			// grow the receive buffer up front rather than on the first few messages
+			void ReserveBuffers(size_t nBytes)
+			{
+				m_msgTemporaryIn.body.reserve(nBytes);
+			}
+
+			// Close the socket and cancel the timers, so every outstanding handler completes
+			// soon. True once none are left, and the connection can be Reset(). Call from the
+			// context thread
+			bool Quiesce()
+			{
+				boost::system::error_code ec;
+				m_socket.close(ec);
+				m_timerLimit.cancel();
+				m_timerTuning.cancel();
+				return m_nOutstanding == 0;
+			}
+
+			// Recycle this connection for a newly accepted socket. Everything belonging to the
+			// previous remote is dropped, settings included, so each is only what the accept
+			// path gives it afresh. Buffer capacity is kept for the next one
+			void Reset(boost::asio::ip::tcp::socket socket)
+			{
+				m_nEpoch++;
+				m_socket = std::move(socket);
+				m_qMessagesOut.clear();
+				m_msgTemporaryIn.header = {};
+				m_msgTemporaryIn.body.clear();
+				id = 0;
+				m_bValidated = false;
+				m_bWriting = false;
+				m_fileOut = {};
+				m_nFeaturesOut = 0;
+				m_nFeaturesIn = 0;
+				m_nFeatures = 0;
+				m_nIdentity = 0;
+				m_fnOnDrained = nullptr;
+				m_fnOnValidated = nullptr;
+				m_nStripeGroup = 0;
+				m_pStripe.reset();
+				m_pTracer.reset();
+				m_pBodyPool.reset();
+				m_pFixedLayout.reset();
+				m_pResume.reset();
+				m_resumeToken = {};
+				m_bResuming = false;
+				m_bResumed = false;
+				m_bSuperseded = false;
+
+				// Limits belong to the previous remote too
+				m_timerLimit.cancel();
+				m_pLimiter.reset();
+				m_nRateLimited = 0;
+
+				// As does the link the buffers were sized for
+				m_timerTuning.cancel();
+				m_pTuning.reset();
+				m_tuner.Reset();
+				m_nBytesOut = 0;
+				m_nBytesIn = 0;
+
+#ifdef OLC_NET_TLS
+				// TLS state belongs to the old socket, the new one gets its own if enabled again
+				m_pTLS.reset();
+				m_pTLSSessions.reset();
+#endif
+
+				// A fresh remote needs a fresh puzzle
+				PrepareHandshake();
+			}
+
 		public:
 			void ConnectToClient(olc::net::server_interface<T>* server, uint32_t uid = 0)
 			{
@@ -61,8 +320,32 @@ namespace olc
 					if (m_socket.is_open())
 					{
 						id = uid;
+						ApplySocketTuning();
 
-						// A client has attempted to connect to the server
+#ifdef OLC_NET_TLS
+						// With TLS the link is secured first, and validation then runs over it
+						if (m_pTLS)
+						{
+							m_pTLS->async_handshake(boost::asio::ssl::stream_base::server,
+								Guard([this, server](std::error_code ec)
+								{
+									if (!ec)
+									{
+										WriteValidation();
+										ReadValidation(server);
+									}
+									else
+									{
+										std::cout << "[" << id << "] TLS Handshake Fail.\n";
+										m_socket.close();
+									}
+								}));
+							return;
+						}
+#endif
+
+						// A client has attempted to connect to the server.
+						// (One coming back with a resume_token says so in its answer, see ReadValidation())
 						// We wish the client to first validate itself, so first write out the handshake data to be validated
 						WriteValidation();
 
@@ -79,25 +362,56 @@ namespace olc
 				{
 					// Request asio attempts to connect to an endpoint
 					boost::asio::async_connect(m_socket, endpoints,
-						[this](std::error_code ec, boost::asio::ip::tcp::endpoint endpoint)
+						Guard([this](std::error_code ec, boost::asio::ip::tcp::endpoint endpoint)
 						{
 							if (!ec)
 							{
+								ApplySocketTuning();
+
+#ifdef OLC_NET_TLS
+								if (m_pTLS)
+								{
+									// Offer the last session this client had, so the server can skip
+									// the full handshake
+									if (m_pTLSSessions)
+										m_pTLSSessions->Apply(m_pTLS->native_handle());
+
+									m_pTLS->async_handshake(boost::asio::ssl::stream_base::client,
+										Guard([this](std::error_code ec)
+										{
+											if (!ec)
+											{
+												StartValidation();
+											}
+											else
+											{
+												std::cout << "[" << id << "] TLS Handshake Fail.\n";
+												m_socket.close();
+											}
+										}));
+									return;
+								}
+#endif
 								// First thing server will do is send packet to be validated 
-								// so wait for that and respond
-								ReadValidation();
+								// so wait for that and respond, unless we have a token to skip it
+								StartValidation();
+							}
+							else
+							{
+								// Nobody there, so no longer count as connected
+								m_socket.close();
 							}
-						});
+						}));
 				}
 			}
 			void Disconnect()
 			{
 				if (IsConnected())
 					boost::asio::post(m_asioContext,
-						[this]()
+						Guard([this]()
 						{
 							m_socket.close();
-						});
+						}));
 			}
 			bool IsConnected() const
 			{
@@ -105,44 +419,112 @@ namespace olc
 			}
 		public:
 			// Async - Send a message, connections are one-to-one
-			// so no need to specify the target, for a client, the target is the server and vice versa
-			void Send(const message<T>& msg)
+			// so no need to specify the target, for a client, the target is the server and vice versa.
+			// Messages of a higher priority overtake those waiting in lower priority lanes.
+			// A message passed with std::move() goes all the way to the socket without being copied
+			void Send(message<T> msg, priority nPriority = priority::normal)
 			{
+				// Nowhere to send it, so don't leave it waiting in the context
+				if (!IsConnected())
+					return;
+
+				message<T> msgOut = std::move(msg);
+				BeginTrace(msgOut);
+
 				boost::asio::post(m_asioContext,
-					[this, msg]()
+					Guard([this, msgOut = std::move(msgOut), nPriority]() mutable
 					{
-						// If the queue has a message in it, 
-						// then we must assume that it is in the process of asynchronously being written.
-						// If no messages were available to be written, then start the process of writing the message
-						bool bWriteingMessage = !m_qMessagesOut.empty();
-						m_qMessagesOut.push_back(msg);
-						if (!bWriteingMessage)
+						msgOut.trace.Stamp(trace_stage::enqueue);
+
+						// If a write is in progress, it will carry on through the queue to this message.
+						// Otherwise start the process of writing the message
+						m_qMessagesOut.push_back(std::move(msgOut), nPriority);
+
+						// Nothing goes out ahead of validation, the two sides haven't yet agreed on
+						// the frame format. Validation starts the writing if it had to wait
+						if (!m_bWriting && m_bValidated)
 						{
 							WriteHeader();
 						}
-					});
+					}));
+			}
+
+			// Async - Send a message for which only the latest value matters, such as a state
+			// update. If a message with the same key is still waiting to be written it is replaced
+			// by this one, so a slow remote never falls behind on stale data
+			void SendConflated(uint64_t nKey, message<T> msg, priority nPriority = priority::normal)
+			{
+				if (!IsConnected())
+					return;
+
+				message<T> msgOut = std::move(msg);
+				BeginTrace(msgOut);
+
+				boost::asio::post(m_asioContext,
+					Guard([this, nKey, msgOut = std::move(msgOut), nPriority]() mutable
+					{
+						msgOut.trace.Stamp(trace_stage::enqueue);
+
+						m_qMessagesOut.push_conflated(nKey, std::move(msgOut), nPriority);
+						if (!m_bWriting && m_bValidated)
+						{
+							WriteHeader();
+						}
+					}));
+			}
+
+			// Async - Send a message whose body carries on with a region of a file, for serving
+			// large assets. The remote receives an ordinary message with the file's bytes at the
+			// end of its body, but they are never copied into it: on Linux they go from the page
+			// cache straight to the socket with sendfile(), elsewhere (and under TLS) they are
+			// written from a mapped view. The body and region together must fit in one frame, so
+			// anything bigger is refused, returning false, and is best sent as several regions
+			bool SendFile(message<T> msg, file_region file, priority nPriority = priority::normal)
+			{
+				if (!IsConnected())
+					return false;
+
+				uint64_t nSize = uint64_t(msg.body.size()) + file.nLength;
+				if (nSize > UINT32_MAX)
+				{
+					std::cout << "[" << id << "] File Too Large For One Frame.\n";
+					return false;
+				}
+
+				message<T> msgOut = std::move(msg);
+				msgOut.header.size = uint32_t(nSize);
+				BeginTrace(msgOut);
+
+				boost::asio::post(m_asioContext,
+					Guard([this, msgOut = std::move(msgOut), file = std::move(file), nPriority]() mutable
+					{
+						msgOut.trace.Stamp(trace_stage::enqueue);
+
+						m_qMessagesOut.push_back(std::move(msgOut), std::move(file), nPriority);
+						if (!m_bWriting && m_bValidated)
+						{
+							WriteHeader();
+						}
+					}));
+				return true;
 			}
 
 		private:
 			// Async - Prime context ready to read a message header
 			void ReadHeader()
 			{
-				boost::asio::async_read(m_socket, boost::asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
+				AsyncRead(boost::asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
 					[this](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							// A complete message header has been read, check if this message has a body to follow...
-							if (m_msgTemporaryIn.header.size > 0)
-							{
-								m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.size);
-								ReadBody();
-							}
-							else
-							{
-								// it doesn't so add this bodyless message to the connections incoming message queue
-								AddToIncomingMessageQueue();
-							}
+							if (m_pTracer)
+								m_pTracer->Begin(m_msgTemporaryIn.trace, trace_stage::read_header);
+
+							if (m_pTuning && m_pTuning->bQuickAck)
+								m_tuner.RearmQuickAck(m_socket);
+
+							OnHeaderRead();
 						}
 						else
 						{
@@ -154,16 +536,112 @@ namespace olc
 					});
 			}
 
+			// A complete message header has been read. It is checked against the rate limit first,
+			// so a client over its limit can't make us allocate for, or queue, its messages
+			void OnHeaderRead()
+			{
+				// A fixed layout message of the wrong size means the remote disagrees about the
+				// protocol, so, as with a bad checksum, the stream can't be trusted any further
+				if (m_pFixedLayout && !m_pFixedLayout->Check(m_msgTemporaryIn.header))
+				{
+					std::cout << "[" << id << "] Frame Size Mismatch.\n";
+					m_socket.close();
+					return;
+				}
+
+				if (m_pLimiter)
+				{
+					auto tWait = m_pLimiter->Admit(m_msgTemporaryIn.header);
+					if (tWait != std::chrono::steady_clock::duration::zero())
+					{
+						m_nRateLimited++;
+						switch (m_pLimiter->Action())
+						{
+						case limit_action::pause:
+							// Nothing more is read meanwhile, so the client is held back by TCP
+							m_timerLimit.expires_after(tWait);
+							m_timerLimit.async_wait(
+								Guard([this](std::error_code ec)
+								{
+									if (!ec)
+									{
+										m_nRateLimited--;
+										OnHeaderRead();
+									}
+								}));
+							return;
+
+						case limit_action::drop:
+							DiscardBody(m_msgTemporaryIn.header.size);
+							return;
+
+						case limit_action::disconnect:
+							std::cout << "[" << id << "] Rate Limit Exceeded.\n";
+							m_socket.close();
+							return;
+						}
+					}
+				}
+
+				// Check if this message has a body to follow...
+				if (m_msgTemporaryIn.header.size > 0)
+				{
+					// The last body went with its message, so if this one won't fit inline
+					// start from a recycled buffer
+					if (m_pBodyPool && !m_msgTemporaryIn.body.on_heap() && m_msgTemporaryIn.header.size > MESSAGE_INLINE_BYTES)
+						m_msgTemporaryIn.body = m_pBodyPool->Acquire();
+
+					m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.size);
+					ReadBody();
+				}
+				else if (VerifyChecksum())
+				{
+					m_msgTemporaryIn.trace.Stamp(trace_stage::read_body);
+
+					// it doesn't so add this bodyless message to the connections incoming message queue
+					AddToIncomingMessageQueue();
+				}
+			}
+
+			// Async - Read past the body of a dropped message, a piece at a time, then carry on
+			// with the next header
+			void DiscardBody(size_t nRemaining)
+			{
+				if (nRemaining == 0)
+				{
+					ReadHeader();
+					return;
+				}
+
+				m_vDiscard.resize(std::min(nRemaining, size_t(16 * 1024)));
+				AsyncRead(boost::asio::buffer(m_vDiscard.data(), m_vDiscard.size()),
+					[this, nRemaining](std::error_code ec, std::size_t length)
+					{
+						if (!ec)
+						{
+							DiscardBody(nRemaining - length);
+						}
+						else
+						{
+							std::cout << "[" << id << "] Read Body Fail.\n";
+							m_socket.close();
+						}
+					});
+			}
+
 			// Async - Prime context ready to read a message body
 			void ReadBody()
 			{
 
-				boost::asio::async_read(m_socket, boost::asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
+				AsyncRead(boost::asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
 					[this](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							AddToIncomingMessageQueue();
+							m_msgTemporaryIn.trace.Stamp(trace_stage::read_body);
+
+							if (VerifyChecksum())
+								AddToIncomingMessageQueue();
 						}
 						else
 						{
@@ -173,86 +651,473 @@ namespace olc
 					});
 			}
 
-			// Async - Prime context to write a message haeader
+			// Async - Prime context to write a message, header and body together in one gather write,
+			// so each message costs one send (or one io_uring submission) rather than two
 			void WriteHeader()
 			{
+				m_bWriting = true;
+
+				// A message carrying a file region takes its own path
+				if (!m_qMessagesOut.front_file().empty())
+				{
+					WriteFile();
+					return;
+				}
+
+#ifdef OLC_NET_TLS
+				if (m_pTLS)
+				{
+					WriteStaged();
+					return;
+				}
+#endif
+
 				// If this function is called, we know the outgoing message queue must have at least one message to send
 				// So allocate a transmission buffer to hold the message, 
 				// and issue the work - asio sned thes bytes
-				boost::asio::async_write(m_socket, boost::asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
+				// The header goes out from its own buffer, so the checksum can be filled in
+				// without touching the queued message
+				m_qMessagesOut.front().trace.Stamp(trace_stage::write_start);
+				m_headerOut = m_qMessagesOut.front().header;
+				if (m_nFeatures & FEATURE_CHECKSUM)
+					m_headerOut.checksum = FrameChecksum(m_qMessagesOut.front());
+
+				// An empty body adds an empty buffer, which asio simply skips
+				auto& body = m_qMessagesOut.front().body;
+				std::array<boost::asio::const_buffer, 2> buffers = {
+					boost::asio::buffer(&m_headerOut, sizeof(message_header<T>)),
+					boost::asio::buffer(body.data(), body.size()) };
+
+				AsyncWrite(buffers,
 					[this](std::error_code ec, std::size_t length)
 					{
 						// asio has now sent the bytes - if there was a problem an error would be available
 						if (!ec)
 						{
-							// check if the message header jst sent also has a message body
-							if (m_qMessagesOut.front().body.size() > 0)
-							{
-								// ...it does, so issue the task to write the body bytes
-								WriteBody();
-							}
-							else
-							{
-								// ...it didn't 
-								// So we are done with this message.
-								// Remove it from the outgoing message queue
-								m_qMessagesOut.pop_front();
-
-								// If the queue is not empty, there are more messages to send,
-								// so make this happen by issuing the task to send the next header.
-								if (!m_qMessagesOut.empty())
+							// Sending was successful
+							OnFrameWritten();
+						}
+						else
+						{
+							std::cout << "[" << id << "] Write Fail.\n";
+							m_socket.close();
+						}
+					});
+			}
+
+			// Async - Write a message whose body carries on with a file region. The header and the
+			// in-memory part of the body go out first, in one gather write, and then the file
+			void WriteFile()
+			{
+				auto& msg = m_qMessagesOut.front();
+				m_fileOut = m_qMessagesOut.front_file();
+
+				msg.trace.Stamp(trace_stage::write_start);
+				m_headerOut = msg.header;
+				if (m_nFeatures & FEATURE_CHECKSUM)
+					m_headerOut.checksum = FrameChecksum(msg, m_fileOut);
+
+				std::array<boost::asio::const_buffer, 2> buffers = {
+					boost::asio::buffer(&m_headerOut, sizeof(message_header<T>)),
+					boost::asio::buffer(msg.body.data(), msg.body.size()) };
+
+				AsyncWrite(buffers,
+					[this](std::error_code ec, std::size_t length)
+					{
+						if (!ec)
+						{
+							WriteFileRegion(m_fileOut.nOffset, m_fileOut.nLength);
+						}
+						else
+						{
+							std::cout << "[" << id << "] Write Fail.\n";
+							m_socket.close();
+						}
+					});
+			}
+
+			// Async - Write the rest of the current file region, nRemaining bytes from nOffset
+			void WriteFileRegion(uint64_t nOffset, uint64_t nRemaining)
+			{
+#if defined(__linux__)
+#ifdef OLC_NET_TLS
+				if (!m_pTLS)
+#endif
+				{
+					// sendfile() takes as much as the socket will accept without blocking, and the
+					// rest waits until the socket can be written to again
+					boost::system::error_code ecMode;
+					m_socket.native_non_blocking(true, ecMode);
+					bool bFailed = bool(ecMode);
+
+					while (!bFailed && nRemaining > 0)
+					{
+						off_t nPos = off_t(nOffset);
+						ssize_t nSent = ::sendfile(m_socket.native_handle(), m_fileOut.source->Handle(), &nPos, size_t(nRemaining));
+						if (nSent > 0)
+						{
+							nOffset += uint64_t(nSent);
+							nRemaining -= uint64_t(nSent);
+							m_nBytesOut += uint64_t(nSent);
+						}
+						else if (nSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+						{
+							m_socket.async_wait(boost::asio::ip::tcp::socket::wait_write,
+								Guard([this, nOffset, nRemaining](std::error_code ec)
 								{
-									WriteHeader();
-								}
-							}
+									if (!ec)
+									{
+										WriteFileRegion(nOffset, nRemaining);
+									}
+									else
+									{
+										std::cout << "[" << id << "] Write Fail.\n";
+										m_socket.close();
+									}
+								}));
+							return;
+						}
+						else if (nSent == 0 || errno != EINTR)
+						{
+							// Nothing sent means the file has shrunk since the header went out
+							bFailed = true;
+						}
+					}
+
+					if (!bFailed)
+					{
+						OnFrameWritten();
+					}
+					else
+					{
+						std::cout << "[" << id << "] Write Fail.\n";
+						m_socket.close();
+					}
+					return;
+				}
+#endif
+
+				AsyncWrite(boost::asio::buffer(m_fileOut.data() + (nOffset - m_fileOut.nOffset), size_t(nRemaining)),
+					[this](std::error_code ec, std::size_t length)
+					{
+						if (!ec)
+						{
+							OnFrameWritten();
 						}
 						else
 						{
-							std::cout << "[" << id << "] Write Header Fail.\n";
+							std::cout << "[" << id << "] Write Fail.\n";
 							m_socket.close();
 						}
 					});
 			}
 
-			// Async - Priem context tot write a message body
-			void WriteBody()
+			// The message at the front of the queue has been written in full, so we are done with it
+			// and remove it from the queue
+			void OnFrameWritten()
+			{
+				if (m_pTracer)
+				{
+					auto& msg = m_qMessagesOut.front();
+					msg.trace.Stamp(trace_stage::write_end);
+					m_pTracer->Commit(msg.trace, id, uint32_t(msg.header.id));
+				}
+				m_qMessagesOut.pop_front();
+				m_fileOut = {};
+
+				// If the queue still has messages in it,
+				// then issue the task to send the next messages' header
+				if (!m_qMessagesOut.empty())
+				{
+					WriteHeader();
+				}
+				else
+				{
+					m_bWriting = false;
+					OnQueueDrained();
+				}
+			}
+
+			// Nothing is left to write, let whoever is feeding the queue know
+			void OnQueueDrained()
 			{
-				boost::asio::async_write(m_socket, boost::asio::buffer(m_qMessagesOut.front().body.data(), m_qMessagesOut.front().body.size()),
+				if (m_fnOnDrained)
+				{
+					// It may well clear itself
+					auto fn = m_fnOnDrained;
+					fn();
+				}
+			}
+
+#ifdef OLC_NET_TLS
+			// Async - Under TLS every write becomes at least one record, each with its own overhead
+			// and encryption pass, so rather than writing messages one at a time, copy as many queued
+			// frames as fit in one record into a staging buffer and write them together. At least
+			// one whole frame always goes, however big it is
+			void WriteStaged()
+			{
+				m_vStaging.clear();
+				m_vStagedTraces.clear();
+
+				while (!m_qMessagesOut.empty())
+				{
+					auto& msg = m_qMessagesOut.front();
+
+					// A file region isn't staged, it goes out by itself once everything ahead has gone
+					if (!m_qMessagesOut.front_file().empty())
+						break;
+
+					size_t nFrame = sizeof(message_header<T>) + msg.body.size();
+					if (!m_vStaging.empty() && m_vStaging.size() + nFrame > TLS_RECORD_BYTES)
+						break;
+
+					msg.trace.Stamp(trace_stage::write_start);
+
+					message_header<T> header = msg.header;
+					if (m_nFeatures & FEATURE_CHECKSUM)
+						header.checksum = FrameChecksum(msg);
+
+					size_t i = m_vStaging.size();
+					m_vStaging.resize(i + nFrame);
+					std::memcpy(m_vStaging.data() + i, &header, sizeof(header));
+					std::memcpy(m_vStaging.data() + i + sizeof(header), msg.body.data(), msg.body.size());
+
+					if (msg.trace.Sampled())
+						m_vStagedTraces.push_back({ uint32_t(msg.header.id), std::move(msg.trace) });
+
+					// It's in the staging buffer now, so it is finished with
+					m_qMessagesOut.pop_front();
+				}
+
+				AsyncWrite(boost::asio::buffer(m_vStaging.data(), m_vStaging.size()),
 					[this](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							// Sending was successful
-							// so we are done with the message and remove it from the queue
-							m_qMessagesOut.pop_front();
+							if (m_pTracer)
+							{
+								for (auto& [nID, trace] : m_vStagedTraces)
+								{
+									trace.Stamp(trace_stage::write_end);
+									m_pTracer->Commit(trace, id, nID);
+								}
+							}
 
-							// If the queue still has messages in it,
-							// then issue the task to send the next messages' header
 							if (!m_qMessagesOut.empty())
 							{
 								WriteHeader();
 							}
+							else
+							{
+								m_bWriting = false;
+								OnQueueDrained();
+							}
 						}
 						else
 						{
-							std::cout << "[" << id << "] Write Body Fail.\n";
+							std::cout << "[" << id << "] Write Fail.\n";
 							m_socket.close();
 						}
 					});
 			}
+#endif
+
+			// Reads and writes go through TLS when it is enabled, straight to the socket otherwise.
+			// Bytes are counted on the way, for sizing the socket's buffers to the link
+			template<typename Buffers, typename Handler>
+			void AsyncRead(const Buffers& buffers, Handler&& handler)
+			{
+				auto counted = [this, handler = std::forward<Handler>(handler)](std::error_code ec, std::size_t length) mutable
+				{
+					m_nBytesIn += length;
+					handler(ec, length);
+				};
+
+#ifdef OLC_NET_TLS
+				if (m_pTLS)
+				{
+					boost::asio::async_read(*m_pTLS, buffers, Guard(std::move(counted)));
+					return;
+				}
+#endif
+				boost::asio::async_read(m_socket, buffers, Guard(std::move(counted)));
+			}
+
+			template<typename Buffers, typename Handler>
+			void AsyncWrite(const Buffers& buffers, Handler&& handler)
+			{
+				auto counted = [this, handler = std::forward<Handler>(handler)](std::error_code ec, std::size_t length) mutable
+				{
+					m_nBytesOut += length;
+					handler(ec, length);
+				};
+
+#ifdef OLC_NET_TLS
+				if (m_pTLS)
+				{
+					boost::asio::async_write(*m_pTLS, buffers, Guard(std::move(counted)));
+					return;
+				}
+#endif
+				boost::asio::async_write(m_socket, buffers, Guard(std::move(counted)));
+			}
+
+			// Every handler handed to the context goes through here. Handlers hold a plain this,
+			// so Reset() moves the connection on to a new epoch, and one left over from the
+			// previous socket does nothing when it runs. The pool also waits for the count of
+			// those outstanding to reach zero before handing the connection out again
+			template<typename Handler>
+			auto Guard(Handler&& handler)
+			{
+				m_nOutstanding++;
+				// Only as callable as the handler itself, for asio telling overloads apart
+				return [this, nEpoch = m_nEpoch.load(), handler = std::forward<Handler>(handler)](auto&&... args) mutable
+					requires std::invocable<std::decay_t<Handler>&, decltype(args)...>
+				{
+					m_nOutstanding--;
+					if (nEpoch == m_nEpoch)
+						handler(std::forward<decltype(args)>(args)...);
+				};
+			}
+
+			// Tune the newly connected socket, and keep its buffers sized to the link if asked to
+			void ApplySocketTuning()
+			{
+				if (!m_pTuning)
+					return;
+
+				m_tuner.Apply(m_socket, *m_pTuning);
+				if (m_pTuning->bAdaptiveBuffers)
+					AdaptSocketBuffers();
+			}
+
+			void AdaptSocketBuffers()
+			{
+				m_timerTuning.expires_after(m_pTuning->tAdaptInterval);
+				m_timerTuning.async_wait(
+					Guard([this](std::error_code ec)
+					{
+						if (ec || !IsConnected() || !m_pTuning)
+							return;
+
+						m_tuner.Adapt(m_socket, *m_pTuning, m_nBytesOut, m_nBytesIn);
+						AdaptSocketBuffers();
+					}));
+			}
 			// Async - Prime context to write a message header
 			void AddToIncomingMessageQueue()
 			{
+				m_msgTemporaryIn.trace.Stamp(trace_stage::queued);
+
+				// The message is moved into the queue, body and all, so nothing is copied on its
+				// way to the handler. The next body is read into a fresh (or recycled) buffer
 				if (m_nOwnerType == owner::server)
-					m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn });
+					m_qMessagesIn.emplace_back(owned_message<T>{ this->shared_from_this(), std::move(m_msgTemporaryIn) });
 				else
-					m_qMessagesIn.push_back({ nullptr, m_msgTemporaryIn });
+				{
+					// Clients have no Update() of their own, so their traces end here
+					if (m_pTracer)
+						m_pTracer->Commit(m_msgTemporaryIn.trace, id, uint32_t(m_msgTemporaryIn.header.id));
 
+					// Clients are usually owned outright, but one held by a shared_ptr (such as
+					// a cluster peer link) still says where its messages came from
+					m_qMessagesIn.emplace_back(owned_message<T>{ this->weak_from_this().lock(), std::move(m_msgTemporaryIn) });
+				}
+				m_msgTemporaryIn.body.clear();
 
 				ReadHeader();
 			}
 
 
+			// Start tracing an outgoing message if it is sampled. A message being passed on carries
+			// the trace of its arrival, which mustn't be stamped as if it were a new one
+			void BeginTrace(message<T>& msg)
+			{
+				if (m_pTracer)
+					m_pTracer->Begin(msg.trace, trace_stage::send);
+				else
+					msg.trace.Reset(0);
+			}
+
+			// CRC32C over the header fields and body of a frame, the checksum field itself excluded
+			uint32_t FrameChecksum(const message<T>& msg)
+			{
+				uint32_t nCRC = crc32c(&msg.header.id, sizeof(msg.header.id));
+				nCRC = crc32c(&msg.header.size, sizeof(msg.header.size), nCRC);
+				return crc32c(msg.body.data(), msg.body.size(), nCRC);
+			}
+
+			// As above, for a frame whose body carries on with a file region
+			uint32_t FrameChecksum(const message<T>& msg, const file_region& file)
+			{
+				uint32_t nCRC = FrameChecksum(msg);
+				return file.empty() ? nCRC : crc32c(file.data(), file.nLength, nCRC);
+			}
+
+			// Check the frame just read, if checksums are in use. A corrupt frame never reaches the
+			// incoming queue, and as the stream can no longer be trusted the connection is closed
+			bool VerifyChecksum()
+			{
+				if (!(m_nFeatures & FEATURE_CHECKSUM) || FrameChecksum(m_msgTemporaryIn) == m_msgTemporaryIn.header.checksum)
+					return true;
+
+				std::cout << "[" << id << "] Checksum Fail.\n";
+				m_socket.close();
+				return false;
+			}
+
+			// Validation is complete, so the frame format is settled and the connection can get going
+			void OnValidated()
+			{
+				m_bValidated = true;
+
+				// Sit waiting to receive data now. A client that is striping or can resume first
+				// hears what the server has issued it
+				if (m_nOwnerType == owner::client && (m_nFeatures & (FEATURE_RESUME | FEATURE_STRIPE)))
+				{
+					ReadAdmission();
+				}
+				else
+				{
+					NotifyValidated();
+					ReadHeader();
+				}
+
+				// ...and send anything that was queued up while validating
+				if (!m_qMessagesOut.empty())
+					WriteHeader();
+			}
+
+			// Run the validated handler, if there is one, just the once
+			void NotifyValidated()
+			{
+				if (m_fnOnValidated)
+				{
+					auto fn = std::move(m_fnOnValidated);
+					m_fnOnValidated = nullptr;
+					fn();
+				}
+			}
+
+			// Construct the validation data for this connection
+			void PrepareHandshake()
+			{
+				if (m_nOwnerType == owner::server)
+				{
+					// Connection is Server -> Client,
+					// Construct random data for the client to transform ans send back for validation
+					m_nHandshakeOut = uint64_t(std::chrono::system_clock::now().time_since_epoch().count());
+
+					// Pre-calculate the result for checking when the client responds
+					m_nHandshakeCheck = scramble(m_nHandshakeOut);
+				}
+				else
+				{
+					m_nHandshakeIn = 0;
+					m_nHandshakeOut = 0;
+				}
+			}
+
 			// encrypt
 			// Ŭ̾Ʈ 
 			// Ϻ  Ͽ  ִ´ٸ  ε   
@@ -266,14 +1131,22 @@ namespace olc
 			// Async - Used by both client and server to write validation packet
 			void WriteValidation()
 			{
-				boost::asio::async_write(m_socket, boost::asio::buffer(&m_nHandshakeOut, sizeof(uint64_t)),
+				// The puzzle (or its answer) goes out together with the features we want, and a
+				// striping client's answer with the stripe group it joins, 0 for a new one
+				bool bGroup = m_nOwnerType == owner::client && (m_nFeaturesOut & FEATURE_STRIPE);
+				std::array<boost::asio::const_buffer, 3> buffers = {
+					boost::asio::buffer(&m_nHandshakeOut, sizeof(uint64_t)),
+					boost::asio::buffer(&m_nFeaturesOut, sizeof(uint32_t)),
+					boost::asio::buffer(&m_nStripeGroup, bGroup ? sizeof(uint64_t) : 0) };
+
+				AsyncWrite(buffers,
 					[this](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
 							// Validation data sent, clients should sit and wait for a response (or a closure)
 							if (m_nOwnerType == owner::client)
-								ReadHeader();
+								OnValidated();
 
 						}
 						else
@@ -285,7 +1158,11 @@ namespace olc
 
 			void ReadValidation(olc::net::server_interface<T>* server = nullptr)
 			{
-				boost::asio::async_read(m_socket, boost::asio::buffer(&m_nHandshakeIn, sizeof(uint64_t)),
+				std::array<boost::asio::mutable_buffer, 2> buffers = {
+					boost::asio::buffer(&m_nHandshakeIn, sizeof(uint64_t)),
+					boost::asio::buffer(&m_nFeaturesIn, sizeof(uint32_t)) };
+
+				AsyncRead(buffers,
 					[this, server](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
@@ -296,11 +1173,19 @@ namespace olc
 								{
 									// CLient has proveided valid solution, so allow it to connect
 									std::cout << "Client Validated" << std::endl;
-									server->OnClientValidated(this->shared_from_this());
 
+									// The client only answers with features we offered
+									m_nFeatures = m_nFeaturesOut & m_nFeaturesIn;
 
-									// Sit waiting to receive data now
-									ReadHeader();
+									if (m_nFeatures & FEATURE_STRIPE)
+										ReadStripeGroup(server);
+									else
+										Admit(server);
+								}
+								else if ((m_nFeaturesIn & FEATURE_RESUMING) && m_pResume)
+								{
+									// No answer to the puzzle, but a token from an earlier connection
+									ReadPresentedToken(server);
 								}
 								else
 								{
@@ -313,6 +1198,11 @@ namespace olc
 							{
 								// Connection is a client , so solve puzzle
 								m_nHandshakeOut = scramble(m_nHandshakeIn);
+
+								// Settle on the features both sides want, and tell the server
+								m_nFeatures = m_nFeaturesOut & m_nFeaturesIn;
+								m_nFeaturesOut = m_nFeatures;
+
 								// write the result
 								WriteValidation();
 							}
@@ -326,18 +1216,215 @@ namespace olc
 					});
 			}
 
+			// Async - Server reads which stripe group a striping client's stream belongs to,
+			// which follows its answer to the puzzle
+			void ReadStripeGroup(olc::net::server_interface<T>* server)
+			{
+				AsyncRead(boost::asio::buffer(&m_nStripeGroup, sizeof(uint64_t)),
+					[this, server](std::error_code ec, std::size_t length)
+					{
+						if (!ec)
+						{
+							Admit(server);
+						}
+						else
+						{
+							std::cout << "Client Disconnected (ReadStripeGroup)" << std::endl;
+							m_socket.close();
+						}
+					});
+			}
+
+			// The server has validated the client, so let it in
+			void Admit(olc::net::server_interface<T>* server)
+			{
+				// Peer links between servers have no server_interface watching them
+				if (server)
+				{
+					if ((m_nFeatures & FEATURE_STRIPE) && !server->JoinStripe(this->shared_from_this(), false))
+					{
+						std::cout << "Client Disconnected (Stripe Refused)" << std::endl;
+						m_socket.close();
+						return;
+					}
+					server->OnClientValidated(this->shared_from_this());
+				}
+
+				WriteAdmission();
+			}
+
+			// A client with a token skips the puzzle, otherwise it waits for it as usual
+			void StartValidation()
+			{
+				if (m_resumeToken.empty())
+					ReadValidation();
+				else
+					WriteResumeToken();
+			}
+
+			// Async - Client presents the token from its last connection, along with the features
+			// agreed on then, which it goes on to use straight away. The server's puzzle is
+			// already on its way regardless, and is read past along with the new token. The
+			// server knows the stripe group the token was issued with, so that isn't sent
+			void WriteResumeToken()
+			{
+				m_nHandshakeOut = 0;
+				m_nFeaturesOut = m_nFeatures | FEATURE_RESUMING;
+				m_bResuming = true;
+
+				std::array<boost::asio::const_buffer, 3> buffers = {
+					boost::asio::buffer(&m_nHandshakeOut, sizeof(uint64_t)),
+					boost::asio::buffer(&m_nFeaturesOut, sizeof(uint32_t)),
+					boost::asio::buffer(&m_resumeToken, sizeof(resume_token)) };
+
+				AsyncWrite(buffers,
+					[this](std::error_code ec, std::size_t length)
+					{
+						if (!ec)
+						{
+							// Tokens are good for one go, the reply brings the next one
+							m_resumeToken = {};
+							OnValidated();
+						}
+						else
+						{
+							m_socket.close();
+						}
+					});
+			}
+
+			// Async - Client reads what the server issued it on letting it in, after the puzzle
+			// if it skipped it: the stripe group of a striping stream, and a token if it can
+			// resume. Only then is the client told it has validated
+			void ReadAdmission()
+			{
+				std::array<boost::asio::mutable_buffer, 4> buffers = {
+					boost::asio::buffer(&m_nHandshakeIn, m_bResuming ? sizeof(uint64_t) : 0),
+					boost::asio::buffer(&m_nFeaturesIn, m_bResuming ? sizeof(uint32_t) : 0),
+					boost::asio::buffer(&m_nStripeGroup, (m_nFeatures & FEATURE_STRIPE) ? sizeof(uint64_t) : 0),
+					boost::asio::buffer(&m_resumeToken, (m_nFeatures & FEATURE_RESUME) ? sizeof(resume_token) : 0) };
+
+				AsyncRead(buffers,
+					[this](std::error_code ec, std::size_t length)
+					{
+						if (!ec)
+						{
+							m_bResumed = m_bResuming;
+							NotifyValidated();
+							ReadHeader();
+						}
+						else
+						{
+							// Most likely the server refused the token, or the stripe group
+							std::cout << "[" << id << "] Read Admission Fail.\n";
+							m_resumeToken = {};
+							m_socket.close();
+						}
+					});
+			}
+
+			// Async - Server reads a returning client's token. If it is still good, the client
+			// takes over its old ID and identity with no further round trip
+			void ReadPresentedToken(olc::net::server_interface<T>* server)
+			{
+				AsyncRead(boost::asio::buffer(&m_resumeToken, sizeof(resume_token)),
+					[this, server](std::error_code ec, std::size_t length)
+					{
+						if (ec)
+						{
+							m_socket.close();
+							return;
+						}
+
+						// The client is already sending in the frame format it agreed on last time,
+						// so it can only be taken back if we would still agree to that
+						auto prior = m_pResume->Redeem(m_resumeToken);
+						m_nFeatures = m_nFeaturesOut & m_nFeaturesIn;
+						if (!prior || m_nFeatures != (m_nFeaturesIn & ~FEATURE_RESUMING))
+						{
+							std::cout << "Client Disconnected (Resume Refused)" << std::endl;
+							m_socket.close();
+							return;
+						}
+
+						id = prior->nClientID;
+						m_nIdentity = prior->nIdentity;
+						m_nStripeGroup = prior->nStripeGroup;
+						m_bResumed = true;
+
+						// Its old connection may not have noticed it is gone yet
+						if (auto old = prior->conn.lock())
+						{
+							old->m_bSuperseded = true;
+							old->Disconnect();
+						}
+
+						std::cout << "[" << id << "] Client Resumed" << std::endl;
+						if (server)
+						{
+							// It leads its group under its old ID, whatever the group had before
+							if ((m_nFeatures & FEATURE_STRIPE) && !server->JoinStripe(this->shared_from_this(), true))
+							{
+								std::cout << "Client Disconnected (Stripe Refused)" << std::endl;
+								m_socket.close();
+								return;
+							}
+							server->ClientResumed(this->shared_from_this());
+						}
+
+						WriteAdmission();
+					});
+			}
+
+			// Async - Server tells a validated client the stripe group it put a striping stream
+			// in, and gives it a token to come back with if both sides wanted resumption. They
+			// go out ahead of every frame
+			void WriteAdmission()
+			{
+				bool bToken = (m_nFeatures & FEATURE_RESUME) && m_pResume;
+				bool bGroup = m_nFeatures & FEATURE_STRIPE;
+				if (!bToken && !bGroup)
+				{
+					OnValidated();
+					return;
+				}
+
+				if (bToken)
+					m_resumeToken = m_pResume->Issue(this->shared_from_this(), id, m_nIdentity, m_nStripeGroup);
+
+				std::array<boost::asio::const_buffer, 2> buffers = {
+					boost::asio::buffer(&m_nStripeGroup, bGroup ? sizeof(uint64_t) : 0),
+					boost::asio::buffer(&m_resumeToken, bToken ? sizeof(resume_token) : 0) };
+				AsyncWrite(buffers,
+					[this](std::error_code ec, std::size_t length)
+					{
+						if (!ec)
+						{
+							OnValidated();
+						}
+						else
+						{
+							m_socket.close();
+						}
+					});
+			}
+
 
 		protected:
 			// Each connection has a unique socket to a remote
 			boost::asio::ip::tcp::socket m_socket;
 
+			// Moved on by Reset(), and the handlers given to the context not yet run, see Guard()
+			std::atomic<uint32_t> m_nEpoch = 0;
+			std::atomic<size_t> m_nOutstanding = 0;
+
 			// This context is shared with the whole asio instance
 			//  ε ϳ io_context 
 			// io_context  thread safe ϰ ư
 			boost::asio::io_context& m_asioContext;
 
 			// This queue holds all messages to be send to the remote side of this connection
-			tsqueue<message<T>> m_qMessagesOut;
+			outgoing_queue<T> m_qMessagesOut;
 
 			// This queue holds all messages that have been recieved from the remote side of this connection
 			// Note it is a reference as the "owner" of this connection is expected to provide a queue
@@ -347,6 +1434,15 @@ namespace olc
 			// so we will store the part assembled message here, until it is ready
 			message<T> m_msgTemporaryIn;
 
+			// Header of the message currently being written
+			message_header<T> m_headerOut;
+
+			// File region of the message currently being written, if it has one
+			file_region m_fileOut;
+
+			// The server hands out IDs, including to stand-in connections when replaying a capture
+			friend class olc::net::server_interface<T>;
+
 			// The "owner" decides how some of the connection behaves
 			owner m_nOwnerType = owner::server;
 			uint32_t id = 0;
@@ -355,6 +1451,69 @@ namespace olc
 			uint64_t m_nHandshakeOut = 0;
 			uint64_t m_nHandshakeIn = 0;
 			uint64_t m_nHandshakeCheck = 0;
+
+			// Optional features, requested by this side, offered by the remote and agreed on
+			uint32_t m_nFeaturesOut = 0;
+			uint32_t m_nFeaturesIn = 0;
+			uint32_t m_nFeatures = 0;
+
+			// Set once validation completes, nothing is written before then
+			bool m_bValidated = false;
+
+			// Stage timing for sampled messages, if tracing is on
+			std::shared_ptr<message_tracer> m_pTracer;
+
+			// Set while a write is in flight, it will carry on through the queue by itself
+			bool m_bWriting = false;
+
+			// Optional limit on what the remote may send, the timer it waits on when paused,
+			// and somewhere for the bodies of dropped messages to go
+			std::shared_ptr<rate_limiter<T>> m_pLimiter;
+			boost::asio::steady_timer m_timerLimit;
+			std::vector<uint8_t> m_vDiscard;
+			std::atomic<uint64_t> m_nRateLimited = 0;
+
+			// Where incoming bodies come from once the previous one has been handed on, if set
+			std::shared_ptr<body_pool> m_pBodyPool;
+
+			// Sizes of the fixed layout messages, if any were declared
+			std::shared_ptr<const fixed_layout<T>> m_pFixedLayout;
+
+			// Set by the server, the client's identity and whoever feeds the queue from its spool
+			uint64_t m_nIdentity = 0;
+			std::function<void()> m_fnOnDrained;
+
+			// Striping: the group this stream belongs to, and on the server the group itself,
+			// kept alive by its streams. A client can be told when its stream has validated
+			uint64_t m_nStripeGroup = 0;
+			std::shared_ptr<stripe_group<T>> m_pStripe;
+			std::function<void()> m_fnOnValidated;
+
+			// Socket options applied on connecting, what they came to, and the bytes moved
+			// since, which adaptive buffers are sized from
+			std::shared_ptr<const socket_tuning> m_pTuning;
+			socket_tuner m_tuner;
+			boost::asio::steady_timer m_timerTuning;
+			uint64_t m_nBytesOut = 0;
+			uint64_t m_nBytesIn = 0;
+
+			// Resumption: the server's tokens, and the token this connection was issued (or, on a
+			// client, is about to present). A superseded connection was taken over by a resumed one
+			std::shared_ptr<resume_table<T>> m_pResume;
+			resume_token m_resumeToken;
+			bool m_bResuming = false;
+			bool m_bResumed = false;
+			std::atomic<bool> m_bSuperseded = false;
+
+#ifdef OLC_NET_TLS
+			// TLS layered over m_socket, when enabled, and the client's remembered session
+			std::unique_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket&>> m_pTLS;
+			std::shared_ptr<tls_session_cache> m_pTLSSessions;
+
+			// Frames packed together for the current TLS write, and the traces of those sampled
+			std::vector<uint8_t> m_vStaging;
+			std::vector<std::pair<uint32_t, message_trace>> m_vStagedTraces;
+#endif
 		};
 	}
 }
\ No newline at end of file
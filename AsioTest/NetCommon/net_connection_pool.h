@@ -0,0 +1,146 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "net_tsqueue.h"
+#include "NetMessage.h"
+#include "net_connection.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// Server side connections are expensive to build one by one when thousands of clients
+		// reconnect at once (e.g. after a server restart). The pool keeps idle connection objects,
+		// with their receive buffers already grown, and hands them out to the accept handler.
+		// When the last shared_ptr to a connection goes away it is not deleted, it is reset and
+		// returned to the pool for the next client.
+		template<typename T>
+		class connection_pool : public std::enable_shared_from_this<connection_pool<T>>
+		{
+		public:
+			connection_pool(boost::asio::io_context& asioContext, tsqueue<owned_message<T>>& qIn)
+				: m_asioContext(asioContext), m_qMessagesIn(qIn)
+			{
+
+			}
+
+		public:
+			// Construct nCount idle connections up front, each able to receive nReserveBytes
+			// of message body without reallocating
+			void Prewarm(size_t nCount, size_t nReserveBytes = 0)
+			{
+				std::scoped_lock lock(muxPool);
+
+				m_nReserveBytes = nReserveBytes;
+				m_nMaxIdle = std::max(m_nMaxIdle, nCount);
+
+				while (m_deqIdle.size() < nCount)
+					m_deqIdle.push_back(Construct());
+			}
+
+			// Hand out a connection for a freshly accepted socket, falling back to
+			// constructing a new one if the pool has run dry
+			std::shared_ptr<connection<T>> Acquire(boost::asio::ip::tcp::socket socket)
+			{
+				std::unique_ptr<connection<T>> pConn;
+				{
+					std::scoped_lock lock(muxPool);
+					if (!m_deqIdle.empty())
+					{
+						pConn = std::move(m_deqIdle.back());
+						m_deqIdle.pop_back();
+					}
+				}
+
+				if (pConn)
+					pConn->Reset(std::move(socket));
+				else
+				{
+					pConn = Construct();
+					pConn->Reset(std::move(socket));
+				}
+
+				// The deleter gives the connection back to the pool instead of destroying it.
+				// Only a weak reference is held, so connections outliving the pool are simply deleted
+				std::weak_ptr<connection_pool<T>> wpPool = this->weak_from_this();
+				return std::shared_ptr<connection<T>>(pConn.release(),
+					[wpPool](connection<T>* pDead)
+					{
+						if (auto pPool = wpPool.lock())
+							pPool->Recycle(pDead);
+						else
+							delete pDead;
+					});
+			}
+
+			// Returns number of connections waiting to be reused
+			size_t IdleCount()
+			{
+				std::scoped_lock lock(muxPool);
+				return m_deqIdle.size();
+			}
+
+		private:
+			std::unique_ptr<connection<T>> Construct()
+			{
+				auto pConn = std::make_unique<connection<T>>(connection<T>::owner::server,
+					m_asioContext, boost::asio::ip::tcp::socket(m_asioContext), m_qMessagesIn);
+
+				pConn->ReserveBuffers(m_nReserveBytes);
+				return pConn;
+			}
+
+			void Recycle(connection<T>* pDead)
+			{
+				std::unique_ptr<connection<T>> pConn(pDead);
+
+				// A stopped context runs nothing more, so the handlers still waiting in it can only
+				// be destroyed, never called, and the connection can go straight away
+				if (m_asioContext.stopped())
+					return;
+
+				Park(std::move(pConn));
+			}
+
+			// The last reference can be dropped on any thread, while handlers for the connection's
+			// socket are still waiting in the context. So the connection only goes back into the
+			// pool from within the context, once its socket is closed and the last of them has run
+			void Park(std::unique_ptr<connection<T>> pConn)
+			{
+				boost::asio::post(m_asioContext,
+					[wpPool = this->weak_from_this(), pConn = std::move(pConn)]() mutable
+					{
+						auto pPool = wpPool.lock();
+						if (!pPool)
+							return;
+
+						if (!pConn->Quiesce())
+						{
+							pPool->Park(std::move(pConn));
+							return;
+						}
+
+						std::scoped_lock lock(pPool->muxPool);
+						if (pPool->m_deqIdle.size() < pPool->m_nMaxIdle)
+						{
+							pConn->Reset(boost::asio::ip::tcp::socket(pPool->m_asioContext));
+							pPool->m_deqIdle.push_back(std::move(pConn));
+						}
+					});
+			}
+
+		protected:
+			// Connections are built to live in this context and report into this queue
+			boost::asio::io_context& m_asioContext;
+			tsqueue<owned_message<T>>& m_qMessagesIn;
+
+			// Idle connections, ready to be handed to the next accepted socket
+			std::mutex muxPool;
+			std::deque<std::unique_ptr<connection<T>>> m_deqIdle;
+
+			// Never hold more idle connections than were asked for
+			size_t m_nMaxIdle = 0;
+			size_t m_nReserveBytes = 0;
+		};
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "net_connection.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// The server's connections, readable from any thread without a lock. Readers take a
+		// snapshot, an immutable vector that stays valid for as long as they hold it, however the
+		// list changes meanwhile. Writers copy the current vector, change the copy and publish it
+		// in place of the old one, so a broadcast walking a snapshot never blocks an accept or
+		// a removal, nor they it. Writers are serialized among themselves.
+		//
+		// Copying the list for every accept would make a storm of them quadratic, so additions are
+		// staged first and published together: Add() says when a Publish() needs scheduling, and
+		// everything staged up to that Publish() goes out in one new version
+		template<typename T>
+		class connection_list
+		{
+		public:
+			using snapshot = std::shared_ptr<const std::vector<std::shared_ptr<connection<T>>>>;
+
+			connection_list()
+			{
+				Store(std::make_shared<const std::vector<std::shared_ptr<connection<T>>>>());
+			}
+
+			connection_list(const connection_list<T>&) = delete;
+
+		public:
+			// The connections as they were last published
+			snapshot Snapshot() const
+			{
+				return Load();
+			}
+
+			// Stage a new connection. Returns true if nothing else was staged, in which case
+			// the caller should arrange for Publish() to be called
+			bool Add(std::shared_ptr<connection<T>> conn)
+			{
+				std::scoped_lock lock(muxWriters);
+				m_vStaged.push_back(std::move(conn));
+				return m_vStaged.size() == 1;
+			}
+
+			// Publish every staged connection in one new version
+			void Publish()
+			{
+				std::scoped_lock lock(muxWriters);
+				if (m_vStaged.empty())
+					return;
+
+				auto current = Load();
+				auto next = std::make_shared<std::vector<std::shared_ptr<connection<T>>>>();
+				next->reserve(current->size() + m_vStaged.size());
+				next->insert(next->end(), current->begin(), current->end());
+				next->insert(next->end(), std::make_move_iterator(m_vStaged.begin()), std::make_move_iterator(m_vStaged.end()));
+				m_vStaged.clear();
+				Store(std::move(next));
+			}
+
+			// Publish a version without the given connections
+			void Remove(const std::vector<std::shared_ptr<connection<T>>>& vGone)
+			{
+				if (vGone.empty())
+					return;
+
+				std::scoped_lock lock(muxWriters);
+				auto current = Load();
+				auto next = std::make_shared<std::vector<std::shared_ptr<connection<T>>>>();
+				next->reserve(current->size());
+				for (auto& conn : *current)
+					if (std::find(vGone.begin(), vGone.end(), conn) == vGone.end())
+						next->push_back(conn);
+				Store(std::move(next));
+			}
+
+			// Drop every connection, published and staged
+			void Clear()
+			{
+				std::scoped_lock lock(muxWriters);
+				m_vStaged.clear();
+				Store(std::make_shared<const std::vector<std::shared_ptr<connection<T>>>>());
+			}
+
+		private:
+#if defined(__cpp_lib_atomic_shared_ptr)
+			snapshot Load() const
+			{
+				return m_pSnapshot.load(std::memory_order_acquire);
+			}
+
+			void Store(snapshot next)
+			{
+				m_pSnapshot.store(std::move(next), std::memory_order_release);
+			}
+#else
+			snapshot Load() const
+			{
+				return std::atomic_load_explicit(&m_pSnapshot, std::memory_order_acquire);
+			}
+
+			void Store(snapshot next)
+			{
+				std::atomic_store_explicit(&m_pSnapshot, std::move(next), std::memory_order_release);
+			}
+#endif
+
+		private:
+#if defined(__cpp_lib_atomic_shared_ptr)
+			std::atomic<snapshot> m_pSnapshot;
+#else
+			snapshot m_pSnapshot;
+#endif
+
+			// Serializes writers, and guards connections waiting to be published
+			std::mutex muxWriters;
+			std::vector<std::shared_ptr<connection<T>>> m_vStaged;
+		};
+	}
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "NetCommon.h"
+
+// Hardware CRC32C support is picked at compile time, then confirmed at run time on x86
+#if defined(__x86_64__) || defined(_M_X64)
+#define OLC_NET_CRC32C_X86
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define OLC_NET_CRC32C_TARGET
+#else
+#define OLC_NET_CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define OLC_NET_CRC32C_ARM
+#include <arm_acle.h>
+#define OLC_NET_CRC32C_TARGET
+#endif
+
+namespace olc
+{
+	namespace net
+	{
+		// CRC32C (Castagnoli), as used for the optional frame checksums. Uses the SSE4.2 or
+		// ARMv8 CRC instructions where the CPU has them, and slicing-by-8 tables where it doesn't.
+		// Large buffers are split into three interleaved streams, so the CRC instruction's
+		// latency is hidden, and the three results are stitched together with lookup tables
+		namespace crc32c_detail
+		{
+			// Reflected Castagnoli polynomial
+			constexpr uint32_t POLY = 0x82F63B78;
+
+			// Block sizes for the three way interleave
+			constexpr size_t LONG_BLOCK = 8192;
+			constexpr size_t SHORT_BLOCK = 256;
+
+			struct tables
+			{
+				// Slicing-by-8 tables for the software path
+				uint32_t slice[8][256];
+
+				// Zero-extend a CRC by LONG_BLOCK or SHORT_BLOCK bytes, four byte lookups each
+				uint32_t longShift[4][256];
+				uint32_t shortShift[4][256];
+			};
+
+			// a * b modulo the polynomial, in the reflected bit order CRCs use
+			inline uint32_t multmodp(uint32_t a, uint32_t b)
+			{
+				uint32_t m = uint32_t(1) << 31, p = 0;
+				while (true)
+				{
+					if (a & m)
+					{
+						p ^= b;
+						if ((a & (m - 1)) == 0)
+							break;
+					}
+					m >>= 1;
+					b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+				}
+				return p;
+			}
+
+			// x^(8 * nBytes) modulo the polynomial, the operator for appending nBytes of zeros
+			inline uint32_t xpow8n(size_t nBytes)
+			{
+				uint32_t x2k = uint32_t(1) << 30; // x^1
+				uint32_t xp = uint32_t(1) << 31;  // x^0
+				size_t nBits = nBytes * 8;
+				while (nBits)
+				{
+					if (nBits & 1)
+						xp = multmodp(x2k, xp);
+					x2k = multmodp(x2k, x2k);
+					nBits >>= 1;
+				}
+				return xp;
+			}
+
+			inline void make_shift_table(uint32_t table[4][256], size_t nBytes)
+			{
+				uint32_t xp = xpow8n(nBytes);
+				for (uint32_t k = 0; k < 4; k++)
+					for (uint32_t n = 0; n < 256; n++)
+						table[k][n] = multmodp(xp, n << (8 * k));
+			}
+
+			inline const tables& get_tables()
+			{
+				static const tables t = []()
+				{
+					tables t{};
+					for (uint32_t n = 0; n < 256; n++)
+					{
+						uint32_t crc = n;
+						for (int k = 0; k < 8; k++)
+							crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+						t.slice[0][n] = crc;
+					}
+					for (uint32_t n = 0; n < 256; n++)
+						for (int k = 1; k < 8; k++)
+							t.slice[k][n] = (t.slice[k - 1][n] >> 8) ^ t.slice[0][t.slice[k - 1][n] & 0xFF];
+
+					make_shift_table(t.longShift, LONG_BLOCK);
+					make_shift_table(t.shortShift, SHORT_BLOCK);
+					return t;
+				}();
+				return t;
+			}
+
+			inline uint32_t shift(const uint32_t table[4][256], uint32_t crc)
+			{
+				return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^
+					table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+			}
+
+			// Portable path, 8 bytes per step. Assumes a little endian machine
+			inline uint32_t update_sw(uint32_t crc, const uint8_t* p, size_t n)
+			{
+				const tables& t = get_tables();
+
+				while (n >= 8)
+				{
+					uint64_t w;
+					std::memcpy(&w, p, sizeof(w));
+					w ^= crc;
+					crc = t.slice[7][w & 0xFF] ^ t.slice[6][(w >> 8) & 0xFF] ^
+						t.slice[5][(w >> 16) & 0xFF] ^ t.slice[4][(w >> 24) & 0xFF] ^
+						t.slice[3][(w >> 32) & 0xFF] ^ t.slice[2][(w >> 40) & 0xFF] ^
+						t.slice[1][(w >> 48) & 0xFF] ^ t.slice[0][w >> 56];
+					p += 8;
+					n -= 8;
+				}
+				while (n--)
+					crc = t.slice[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+				return crc;
+			}
+
+#if defined(OLC_NET_CRC32C_X86) || defined(OLC_NET_CRC32C_ARM)
+#if defined(OLC_NET_CRC32C_X86)
+			OLC_NET_CRC32C_TARGET inline uint64_t hw64(uint64_t crc, uint64_t w) { return _mm_crc32_u64(crc, w); }
+			OLC_NET_CRC32C_TARGET inline uint32_t hw8(uint32_t crc, uint8_t b) { return _mm_crc32_u8(crc, b); }
+#else
+			inline uint64_t hw64(uint64_t crc, uint64_t w) { return __crc32cd(uint32_t(crc), w); }
+			inline uint32_t hw8(uint32_t crc, uint8_t b) { return __crc32cb(crc, b); }
+#endif
+
+			inline uint64_t load64(const uint8_t* p)
+			{
+				uint64_t w;
+				std::memcpy(&w, p, sizeof(w));
+				return w;
+			}
+
+			// Three independent CRCs over consecutive blocks, combined at the end
+			template<size_t BLOCK>
+			OLC_NET_CRC32C_TARGET inline uint32_t interleave(uint32_t crc, const uint8_t*& p, size_t& n, const uint32_t table[4][256])
+			{
+				while (n >= 3 * BLOCK)
+				{
+					uint64_t c0 = crc, c1 = 0, c2 = 0;
+					const uint8_t* pEnd = p + BLOCK;
+					do
+					{
+						c0 = hw64(c0, load64(p));
+						c1 = hw64(c1, load64(p + BLOCK));
+						c2 = hw64(c2, load64(p + 2 * BLOCK));
+						p += 8;
+					} while (p < pEnd);
+
+					crc = shift(table, shift(table, uint32_t(c0)) ^ uint32_t(c1)) ^ uint32_t(c2);
+					p += 2 * BLOCK;
+					n -= 3 * BLOCK;
+				}
+				return crc;
+			}
+
+			OLC_NET_CRC32C_TARGET inline uint32_t update_hw(uint32_t crc, const uint8_t* p, size_t n)
+			{
+				const tables& t = get_tables();
+
+				crc = interleave<LONG_BLOCK>(crc, p, n, t.longShift);
+				crc = interleave<SHORT_BLOCK>(crc, p, n, t.shortShift);
+
+				uint64_t c = crc;
+				while (n >= 8)
+				{
+					c = hw64(c, load64(p));
+					p += 8;
+					n -= 8;
+				}
+				crc = uint32_t(c);
+				while (n--)
+					crc = hw8(crc, *p++);
+				return crc;
+			}
+#endif
+
+			using update_fn = uint32_t(*)(uint32_t, const uint8_t*, size_t);
+
+			// Pick the fastest implementation this machine can run, once
+			inline update_fn select()
+			{
+#if defined(OLC_NET_CRC32C_X86)
+#if defined(_MSC_VER)
+				int info[4];
+				__cpuid(info, 1);
+				if (info[2] & (1 << 20))
+					return &update_hw;
+#else
+				if (__builtin_cpu_supports("sse4.2"))
+					return &update_hw;
+#endif
+#elif defined(OLC_NET_CRC32C_ARM)
+				return &update_hw;
+#endif
+				return &update_sw;
+			}
+		}
+
+		// CRC32C of nBytes at pData. Pass a previous result as nCRC to continue a checksum
+		// over data that arrives in pieces
+		inline uint32_t crc32c(const void* pData, size_t nBytes, uint32_t nCRC = 0)
+		{
+			static const crc32c_detail::update_fn fn = crc32c_detail::select();
+			return ~fn(~nCRC, static_cast<const uint8_t*>(pData), nBytes);
+		}
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "NetMessage.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// Forward declare the connection
+		template <typename T>
+		class connection;
+
+		// Binds one message ID to a member function handler of the owning class.
+		//
+		// Payload = void        handler(client, message<T>& msg)
+		// Payload = some POD    handler(client, const Payload& payload)
+		//                   or  handler(client, message<T>& msg, const Payload& payload)
+		//
+		// A POD payload is not copied out of the message, the handler is given a view
+		// straight onto the body bytes, so the body must be exactly sizeof(Payload)
+		template <auto ID, typename Payload, auto Handler>
+		struct bind_message
+		{
+			static constexpr auto id = ID;
+			using payload_type = Payload;
+
+			template <typename T, typename TOwner>
+			static bool Invoke(TOwner& owner, std::shared_ptr<connection<T>>& client, message<T>& msg)
+			{
+				if constexpr (std::is_void_v<Payload>)
+				{
+					(owner.*Handler)(client, msg);
+				}
+				else
+				{
+					static_assert(std::is_trivially_copyable_v<Payload>, "Payload must be plain old data to be viewed in place");
+					static_assert(alignof(Payload) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Payload is more aligned than the body storage");
+
+					// The frame has to be exactly the size we are about to look at
+					if (msg.body.size() != sizeof(Payload))
+						return false;
+
+					const Payload& payload = *std::launder(reinterpret_cast<const Payload*>(msg.body.data()));
+
+					if constexpr (std::is_invocable_v<decltype(Handler), TOwner&, std::shared_ptr<connection<T>>&, const Payload&>)
+						(owner.*Handler)(client, payload);
+					else
+						(owner.*Handler)(client, msg, payload);
+				}
+				return true;
+			}
+		};
+
+		// True if no message ID appears twice in the list
+		constexpr bool distinct_message_ids(std::initializer_list<size_t> ids)
+		{
+			for (auto i = ids.begin(); i != ids.end(); i++)
+				for (auto j = i + 1; j != ids.end(); j++)
+					if (*i == *j)
+						return false;
+			return true;
+		}
+
+		// A jump table from message ID to handler, built at compile time from a list of
+		// bind_message<> entries. Dispatch is a bounds check and one indirect call, instead of
+		// a switch over every ID and hand decoding of the body in each case. IDs are expected to
+		// be small and dense, as with the usual "enum class" message types
+		template <typename T, typename TOwner, typename... Bindings>
+		class message_dispatcher
+		{
+			// A later binding for the same ID would silently replace the earlier one in the table
+			static_assert(distinct_message_ids({ static_cast<size_t>(Bindings::id)... }), "Each message ID may only be bound once");
+
+		public:
+			using handler_fn = bool (*)(TOwner&, std::shared_ptr<connection<T>>&, message<T>&);
+
+			// Returns false if the ID has no handler, or the body doesn't match its payload
+			static bool Dispatch(TOwner& owner, std::shared_ptr<connection<T>>& client, message<T>& msg)
+			{
+				size_t nIndex = static_cast<size_t>(msg.header.id);
+				if (nIndex >= s_table.size())
+					return false;
+
+				return s_table[nIndex](owner, client, msg);
+			}
+
+		private:
+			static bool Unhandled(TOwner&, std::shared_ptr<connection<T>>&, message<T>&)
+			{
+				return false;
+			}
+
+			static constexpr size_t TableSize()
+			{
+				return std::max({ size_t(0), static_cast<size_t>(Bindings::id)... }) + 1;
+			}
+
+			static constexpr std::array<handler_fn, TableSize()> MakeTable()
+			{
+				std::array<handler_fn, TableSize()> table{};
+				for (auto& fn : table)
+					fn = &Unhandled;
+
+				((table[static_cast<size_t>(Bindings::id)] = &Bindings::template Invoke<T, TOwner>), ...);
+				return table;
+			}
+
+			static constexpr std::array<handler_fn, TableSize()> s_table = MakeTable();
+		};
+	}
+}
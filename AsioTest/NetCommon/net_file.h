@@ -0,0 +1,92 @@
+#pragma once
+
+#include "NetCommon.h"
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <cerrno>
+#endif
+
+namespace olc
+{
+	namespace net
+	{
+		// A file opened once and shared by every message that sends part of it. On Linux its
+		// descriptor is handed straight to sendfile(), so the bytes go from the page cache to
+		// the socket without ever being copied into the process. Elsewhere, and under TLS where
+		// the bytes have to be encrypted anyway, the file is memory mapped on first use and
+		// written from the mapping, which still avoids reading it into a buffer of our own.
+		//
+		// Opening throws if the file can't be read, as the mapped log does
+		class file_source
+		{
+		public:
+			explicit file_source(const std::string& sPath)
+				: m_mapping(sPath.c_str(), boost::interprocess::read_only), m_nSize(std::filesystem::file_size(sPath))
+			{
+
+			}
+
+			file_source(const file_source&) = delete;
+
+		public:
+			uint64_t Size() const
+			{
+				return m_nSize;
+			}
+
+			// The whole file, mapped into memory the first time it is asked for
+			const uint8_t* Data()
+			{
+				std::call_once(m_onceMapped, [this]()
+					{
+						if (m_nSize > 0)
+							m_region = boost::interprocess::mapped_region(m_mapping, boost::interprocess::read_only);
+					});
+				return static_cast<const uint8_t*>(m_region.get_address());
+			}
+
+#if defined(__linux__)
+			int Handle() const
+			{
+				return m_mapping.get_mapping_handle().handle;
+			}
+#endif
+
+		private:
+			boost::interprocess::file_mapping m_mapping;
+			boost::interprocess::mapped_region m_region;
+			std::once_flag m_onceMapped;
+			uint64_t m_nSize = 0;
+		};
+
+		// A run of bytes in a file_source, to be sent as (the tail of) a message body
+		struct file_region
+		{
+			std::shared_ptr<file_source> source;
+			uint64_t nOffset = 0;
+			uint64_t nLength = 0;
+
+			file_region() = default;
+
+			// The region is trimmed to fit inside the file. By default it runs to the end
+			file_region(std::shared_ptr<file_source> file, uint64_t offset = 0, uint64_t length = UINT64_MAX)
+				: source(std::move(file))
+			{
+				uint64_t nSize = source ? source->Size() : 0;
+				nOffset = std::min(offset, nSize);
+				nLength = std::min(length, nSize - nOffset);
+			}
+
+			bool empty() const
+			{
+				return nLength == 0;
+			}
+
+			const uint8_t* data() const
+			{
+				return source->Data() + nOffset;
+			}
+		};
+	}
+}
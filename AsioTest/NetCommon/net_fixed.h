@@ -0,0 +1,121 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "NetMessage.h"
+#include "net_dispatch.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// Declares that messages with this ID always carry exactly one Payload, by specialising
+		// with the payload type (or void, for messages that never have a body):
+		//
+		//     template<> struct olc::net::fixed_payload<CustomMsgTypes::TestInt> { using type = int; };
+		//
+		// Payloads that fit in MESSAGE_INLINE_BYTES never touch the heap, and once the IDs are
+		// given to DeclareFixedPayloads() on the client or server, a frame claiming any other
+		// size is refused as soon as its header arrives
+		template <auto ID>
+		struct fixed_payload
+		{
+		};
+
+		template <auto ID, typename = void>
+		struct is_fixed_payload : std::false_type {};
+
+		template <auto ID>
+		struct is_fixed_payload<ID, std::void_t<typename fixed_payload<ID>::type>> : std::true_type {};
+
+		template <auto ID>
+		constexpr bool is_fixed_payload_v = is_fixed_payload<ID>::value;
+
+		template <auto ID>
+		using fixed_payload_t = typename fixed_payload<ID>::type;
+
+		// Bytes a fixed payload takes on the wire
+		template <auto ID>
+		constexpr uint32_t fixed_payload_size()
+		{
+			static_assert(is_fixed_payload_v<ID>, "No fixed_payload declared for this ID");
+			if constexpr (std::is_void_v<fixed_payload_t<ID>>)
+				return 0;
+			else
+			{
+				static_assert(std::is_trivially_copyable_v<fixed_payload_t<ID>>, "Fixed payloads must be plain old data");
+				return uint32_t(sizeof(fixed_payload_t<ID>));
+			}
+		}
+
+		// Build a fixed layout message in one go, with a single copy of a size known at compile time
+		template <auto ID, typename Payload = fixed_payload_t<ID>>
+		message<decltype(ID)> make_fixed(const Payload& payload)
+		{
+			static_assert(std::is_same_v<Payload, fixed_payload_t<ID>>, "Payload doesn't match the one declared for this ID");
+
+			message<decltype(ID)> msg;
+			msg.header.id = ID;
+			msg.header.size = fixed_payload_size<ID>();
+			msg.body.resize(sizeof(Payload));
+			std::memcpy(msg.body.data(), &payload, sizeof(Payload));
+			return msg;
+		}
+
+		template <auto ID>
+		message<decltype(ID)> make_fixed()
+		{
+			static_assert(std::is_void_v<fixed_payload_t<ID>>, "This ID carries a payload");
+
+			message<decltype(ID)> msg;
+			msg.header.id = ID;
+			return msg;
+		}
+
+		// Copy the payload out of a fixed layout message. Returns false if the message isn't
+		// one, or its body isn't the declared size
+		template <auto ID>
+		bool read_fixed(const message<decltype(ID)>& msg, fixed_payload_t<ID>& payload)
+		{
+			if (msg.header.id != ID || msg.body.size() != sizeof(payload))
+				return false;
+
+			std::memcpy(&payload, msg.body.data(), sizeof(payload));
+			return true;
+		}
+
+		// bind_message<> with the payload type taken from the ID's fixed_payload declaration
+		template <auto ID, auto Handler>
+		using bind_fixed = bind_message<ID, fixed_payload_t<ID>, Handler>;
+
+		// Expected body size by message ID, for the IDs declared fixed, checked by connections
+		// against each incoming header. IDs are expected to be small and dense, as with the
+		// usual "enum class" message types
+		template <typename T>
+		class fixed_layout
+		{
+		public:
+			template <auto... IDs>
+			static std::shared_ptr<const fixed_layout<T>> Of()
+			{
+				static_assert((std::is_same_v<decltype(IDs), T> && ...), "IDs must all be of the message type");
+
+				auto layout = std::make_shared<fixed_layout<T>>();
+				size_t nEntries = std::max({ size_t(0), static_cast<size_t>(IDs)... }) + 1;
+				layout->m_vSize.assign(nEntries, NOT_FIXED);
+				((layout->m_vSize[static_cast<size_t>(IDs)] = fixed_payload_size<IDs>()), ...);
+				return layout;
+			}
+
+			// False if this header is for a fixed layout message, but gives a different size
+			bool Check(const message_header<T>& header) const
+			{
+				size_t nIndex = static_cast<size_t>(header.id);
+				return nIndex >= m_vSize.size() || m_vSize[nIndex] == NOT_FIXED || m_vSize[nIndex] == header.size;
+			}
+
+		private:
+			static constexpr uint32_t NOT_FIXED = UINT32_MAX;
+			std::vector<uint32_t> m_vSize;
+		};
+	}
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "NetCommon.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// An append-only log of byte records, written through memory mapped files of a fixed size.
+		// Appending a record is a memcpy into the mapping, the OS writes the pages back in its
+		// own time, so it is cheap enough to leave running. When a segment is full the log moves
+		// on to the next file: "<path>.0", "<path>.1", ...
+		//
+		// Segment layout:  [mapped_log_segment_header][record][record]...[zeros]
+		// Record layout:   [uint32_t size][uint32_t reserved][size bytes][padding to 8 bytes]
+		// A record size of zero (the untouched tail of the file) marks the end of the segment
+
+		struct mapped_log_segment_header
+		{
+			uint32_t nMagic = 0;
+			uint32_t nVersion = 0;
+			uint64_t nSegmentSize = 0;
+		};
+
+		constexpr uint32_t MAPPED_LOG_MAGIC = 0x474C4F4C; // "LOLG"
+		constexpr uint32_t MAPPED_LOG_VERSION = 1;
+		constexpr size_t MAPPED_LOG_RECORD_PREFIX = 2 * sizeof(uint32_t);
+
+		inline std::string mapped_log_segment_name(const std::string& sPath, size_t nIndex)
+		{
+			return sPath + "." + std::to_string(nIndex);
+		}
+
+		inline size_t mapped_log_padded(size_t nBytes)
+		{
+			return (nBytes + 7) & ~size_t(7);
+		}
+
+		class mapped_log_writer
+		{
+		public:
+			// Starts a new log at sPath, discarding any previous log with the same name
+			mapped_log_writer(const std::string& sPath, size_t nSegmentSize)
+				: m_sPath(sPath), m_nSegmentSize(mapped_log_padded(nSegmentSize))
+			{
+				for (size_t i = 0; std::filesystem::exists(mapped_log_segment_name(m_sPath, i)); i++)
+					std::filesystem::remove(mapped_log_segment_name(m_sPath, i));
+
+				OpenSegment(0);
+			}
+
+			virtual ~mapped_log_writer()
+			{
+				Flush();
+			}
+
+		public:
+			// Appends one record made of a head and a body part, either may be empty.
+			// Returns false if the record could never fit in a segment
+			bool Append(const void* pHead, size_t nHead, const void* pBody, size_t nBody)
+			{
+				size_t nRecord = mapped_log_padded(MAPPED_LOG_RECORD_PREFIX + nHead + nBody);
+				if (nRecord > m_nSegmentSize - sizeof(mapped_log_segment_header))
+					return false;
+
+				// Not enough room left, so move on to a fresh segment
+				if (m_nOffset + nRecord > m_nSegmentSize)
+					OpenSegment(m_nSegment + 1);
+
+				uint8_t* pOut = static_cast<uint8_t*>(m_region.get_address()) + m_nOffset;
+				uint32_t nSize = static_cast<uint32_t>(nHead + nBody);
+				if (nHead > 0) std::memcpy(pOut + MAPPED_LOG_RECORD_PREFIX, pHead, nHead);
+				if (nBody > 0) std::memcpy(pOut + MAPPED_LOG_RECORD_PREFIX + nHead, pBody, nBody);
+
+				// The size goes in last, a reader never sees a record that isn't all there
+				std::memcpy(pOut, &nSize, sizeof(uint32_t));
+
+				m_nOffset += nRecord;
+				return true;
+			}
+
+			// Ask the OS to start writing dirty pages back, without waiting for it
+			void Flush()
+			{
+				if (m_region.get_address() != nullptr)
+					m_region.flush(0, 0, true);
+			}
+
+			size_t SegmentCount() const
+			{
+				return m_nSegment + 1;
+			}
+
+		private:
+			void OpenSegment(size_t nIndex)
+			{
+				Flush();
+
+				std::string sName = mapped_log_segment_name(m_sPath, nIndex);
+
+				// Create the file at its full size up front, it stays zero filled until written
+				{
+					std::filebuf fbuf;
+					fbuf.open(sName, std::ios_base::in | std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+					fbuf.pubseekoff(m_nSegmentSize - 1, std::ios_base::beg);
+					fbuf.sputc(0);
+				}
+
+				m_file = boost::interprocess::file_mapping(sName.c_str(), boost::interprocess::read_write);
+				m_region = boost::interprocess::mapped_region(m_file, boost::interprocess::read_write);
+
+				mapped_log_segment_header header;
+				header.nMagic = MAPPED_LOG_MAGIC;
+				header.nVersion = MAPPED_LOG_VERSION;
+				header.nSegmentSize = m_nSegmentSize;
+				std::memcpy(m_region.get_address(), &header, sizeof(header));
+
+				m_nSegment = nIndex;
+				m_nOffset = sizeof(mapped_log_segment_header);
+			}
+
+		protected:
+			std::string m_sPath;
+			size_t m_nSegmentSize = 0;
+
+			// The segment currently being appended to
+			boost::interprocess::file_mapping m_file;
+			boost::interprocess::mapped_region m_region;
+			size_t m_nSegment = 0;
+			size_t m_nOffset = 0;
+		};
+
+		class mapped_log_reader
+		{
+		public:
+			// Opens the log at sPath, throws if there is no first segment
+			mapped_log_reader(const std::string& sPath)
+				: m_sPath(sPath)
+			{
+				if (!OpenSegment(0))
+					throw std::runtime_error("No log found at " + mapped_log_segment_name(sPath, 0));
+			}
+
+		public:
+			// Points pRecord at the next record, which stays valid until the following call.
+			// Returns false once every segment has been read, or at a record that runs past the
+			// end of its segment, as a truncated or corrupt log would have. Nothing is read
+			// after that, and Corrupt() says so
+			bool Next(const uint8_t*& pRecord, size_t& nSize)
+			{
+				while (!m_bCorrupt)
+				{
+					const uint8_t* pBase = static_cast<const uint8_t*>(m_region.get_address());
+					size_t nRegion = m_region.get_size();
+					uint32_t nRecord = 0;
+
+					if (m_nOffset + MAPPED_LOG_RECORD_PREFIX <= nRegion)
+						std::memcpy(&nRecord, pBase + m_nOffset, sizeof(uint32_t));
+
+					// The size comes from the file, so it is only trusted as far as the mapping goes
+					if (nRecord > 0 && nRecord > nRegion - m_nOffset - MAPPED_LOG_RECORD_PREFIX)
+					{
+						std::cerr << "[LOG] Record at " << m_nOffset << " of " << mapped_log_segment_name(m_sPath, m_nSegment)
+							<< " runs past the end of the segment, the log is truncated or corrupt\n";
+						m_bCorrupt = true;
+						return false;
+					}
+
+					if (nRecord > 0)
+					{
+						pRecord = pBase + m_nOffset + MAPPED_LOG_RECORD_PREFIX;
+						nSize = nRecord;
+						m_nOffset += mapped_log_padded(MAPPED_LOG_RECORD_PREFIX + nRecord);
+						return true;
+					}
+
+					// End of this segment, carry on with the next one if there is one
+					if (!OpenSegment(m_nSegment + 1))
+						return false;
+				}
+				return false;
+			}
+
+			// True if reading stopped at a record that didn't fit in its segment
+			bool Corrupt() const
+			{
+				return m_bCorrupt;
+			}
+
+		private:
+			bool OpenSegment(size_t nIndex)
+			{
+				std::string sName = mapped_log_segment_name(m_sPath, nIndex);
+				if (!std::filesystem::exists(sName))
+					return false;
+
+				m_file = boost::interprocess::file_mapping(sName.c_str(), boost::interprocess::read_only);
+				m_region = boost::interprocess::mapped_region(m_file, boost::interprocess::read_only);
+				if (m_region.get_size() < sizeof(mapped_log_segment_header))
+					return false;
+
+				mapped_log_segment_header header;
+				std::memcpy(&header, m_region.get_address(), sizeof(header));
+				if (header.nMagic != MAPPED_LOG_MAGIC || header.nVersion != MAPPED_LOG_VERSION)
+					return false;
+
+				m_nSegment = nIndex;
+				m_nOffset = sizeof(mapped_log_segment_header);
+				return true;
+			}
+
+		protected:
+			std::string m_sPath;
+
+			boost::interprocess::file_mapping m_file;
+			boost::interprocess::mapped_region m_region;
+			size_t m_nSegment = 0;
+			size_t m_nOffset = 0;
+			bool m_bCorrupt = false;
+		};
+	}
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "NetMessage.h"
+#include "net_file.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// Which lane of a connection's outgoing queue a message is sent through
+		enum class priority : uint8_t
+		{
+			control,	// Always goes next, e.g. accept/deny, ping replies
+			high,
+			normal,
+			bulk		// Gets what bandwidth is left over, e.g. map downloads
+		};
+
+		constexpr size_t PRIORITY_LANES = 4;
+
+		// The queue of messages waiting to be written to one connection. Each priority has its own
+		// lane, and messages within a lane always go out in the order they were sent. The control
+		// lane is served first whenever it has anything in it, the others share what is left by
+		// deficit round robin, weighted by bytes, so a lane full of big messages can't starve
+		// the lanes behind it.
+		//
+		// A message that has started writing is never interrupted, so very large messages should
+		// be split up by the sender if control traffic is to overtake them.
+		//
+		// Messages can also be queued under a key, for state where only the latest value matters.
+		// Queueing a keyed message replaces the one already waiting with that key, in its place,
+		// so a slow remote only ever holds one pending message per key
+		template<typename T>
+		class outgoing_queue
+		{
+		public:
+			outgoing_queue() = default;
+			outgoing_queue(const outgoing_queue<T>&) = delete;
+
+		public:
+			// Returns the message to write next. Once chosen, it stays at the front until popped
+			message<T>& front()
+			{
+				std::scoped_lock lock(muxQueue);
+				return Current().msg;
+			}
+
+			// The file region sent after the body of the message returned by front(), if it has one
+			const file_region& front_file()
+			{
+				std::scoped_lock lock(muxQueue);
+				return Current().file;
+			}
+
+			// Removes the message returned by front(), it has been written
+			void pop_front()
+			{
+				std::scoped_lock lock(muxQueue);
+				m_lanes[m_nCurrent].pop_front();
+				m_nCurrent = NO_LANE;
+			}
+
+			// Adds a message to the back of its priority's lane. Messages are taken by value,
+			// so one handed over with std::move() is queued without copying its body
+			void push_back(message<T> msg, priority nPriority = priority::normal)
+			{
+				std::scoped_lock lock(muxQueue);
+				m_lanes[size_t(nPriority)].push_back({ std::move(msg), 0, false, {} });
+			}
+
+			// Adds a message whose body carries on with a region of a file. The file is only read
+			// as the message is written, so queueing it costs no more than queueing the header
+			void push_back(message<T> msg, file_region file, priority nPriority = priority::normal)
+			{
+				std::scoped_lock lock(muxQueue);
+				m_lanes[size_t(nPriority)].push_back({ std::move(msg), 0, false, std::move(file) });
+			}
+
+			// Adds a message under a key. If a message with the same key is still waiting, it is
+			// replaced where it stands (in whichever lane it was queued), otherwise this one joins
+			// the back of its priority's lane
+			void push_conflated(uint64_t nKey, message<T> msg, priority nPriority = priority::normal)
+			{
+				std::scoped_lock lock(muxQueue);
+				auto it = m_mapConflated.find(nKey);
+				if (it != m_mapConflated.end())
+				{
+					*it->second = std::move(msg);
+				}
+				else
+				{
+					auto& lane = m_lanes[size_t(nPriority)];
+					lane.push_back({ std::move(msg), nKey, true, {} });
+					m_mapConflated[nKey] = &lane.back().msg;
+				}
+			}
+
+			// Returns true if no lane has anything in it
+			bool empty()
+			{
+				std::scoped_lock lock(muxQueue);
+				for (auto& lane : m_lanes)
+					if (!lane.empty())
+						return false;
+				return true;
+			}
+
+			// Returns number of messages waiting in all lanes
+			size_t count()
+			{
+				std::scoped_lock lock(muxQueue);
+				size_t nCount = 0;
+				for (auto& lane : m_lanes)
+					nCount += lane.size();
+				return nCount;
+			}
+
+			void clear()
+			{
+				std::scoped_lock lock(muxQueue);
+				Reset();
+			}
+
+			// Empties the queue, handing each message to fn(message, priority), lane by lane in
+			// priority order and in the order they were sent within each lane. Messages with a
+			// file region are dropped. The message front() returned, if it hasn't been popped, is
+			// handed over like the rest, though some or all of it may already have been written
+			template<typename F>
+			void drain(F&& fn)
+			{
+				std::scoped_lock lock(muxQueue);
+				for (size_t i = 0; i < PRIORITY_LANES; i++)
+					for (auto& entry : m_lanes[i])
+						if (entry.file.empty())
+							fn(entry.msg, priority(i));
+				Reset();
+			}
+
+		private:
+			// The entry front() returns, choosing it first if nothing has been chosen yet
+			auto& Current()
+			{
+				if (m_nCurrent == NO_LANE)
+				{
+					m_nCurrent = SelectLane();
+
+					// It is about to be written, so it can no longer be replaced
+					auto& entry = m_lanes[m_nCurrent].front();
+					if (entry.bConflated)
+						m_mapConflated.erase(entry.nKey);
+				}
+				return m_lanes[m_nCurrent].front();
+			}
+
+			void Reset()
+			{
+				for (auto& lane : m_lanes)
+					lane.clear();
+				m_mapConflated.clear();
+				m_nDeficit = {};
+				m_nCurrent = NO_LANE;
+				m_nRoundRobin = size_t(priority::high);
+				m_bFreshVisit = true;
+			}
+
+			// Pick the lane to take the next message from. Must have something queued
+			size_t SelectLane()
+			{
+				// Strict priority for control traffic
+				if (!m_lanes[size_t(priority::control)].empty())
+					return size_t(priority::control);
+
+				// Deficit round robin over the rest. Each visit to a lane tops up its byte allowance,
+				// and it keeps the turn for as long as its next message fits in that allowance
+				while (true)
+				{
+					auto& lane = m_lanes[m_nRoundRobin];
+					if (lane.empty())
+					{
+						// An idle lane doesn't get to save up
+						m_nDeficit[m_nRoundRobin] = 0;
+						NextLane();
+						continue;
+					}
+
+					if (m_bFreshVisit)
+					{
+						m_nDeficit[m_nRoundRobin] += QUANTUM * LANE_WEIGHT[m_nRoundRobin];
+						m_bFreshVisit = false;
+					}
+
+					size_t nCost = sizeof(message_header<T>) + lane.front().msg.body.size() + lane.front().file.nLength;
+					if (m_nDeficit[m_nRoundRobin] >= nCost)
+					{
+						m_nDeficit[m_nRoundRobin] -= nCost;
+						return m_nRoundRobin;
+					}
+
+					NextLane();
+				}
+			}
+
+			void NextLane()
+			{
+				m_nRoundRobin = m_nRoundRobin + 1 < PRIORITY_LANES ? m_nRoundRobin + 1 : size_t(priority::high);
+				m_bFreshVisit = true;
+			}
+
+		protected:
+			struct entry
+			{
+				message<T> msg;
+				uint64_t nKey = 0;
+				bool bConflated = false;
+				file_region file;
+			};
+
+			static constexpr size_t NO_LANE = PRIORITY_LANES;
+
+			// Bytes each weighted lane may send per round, as multiples of the quantum
+			static constexpr size_t QUANTUM = 16 * 1024;
+			static constexpr size_t LANE_WEIGHT[PRIORITY_LANES] = { 0, 4, 2, 1 };
+
+			std::mutex muxQueue;
+			std::array<std::deque<entry>, PRIORITY_LANES> m_lanes;
+
+			// Keyed messages still waiting to be written. Elements of a deque stay where they are
+			// as others are pushed and popped at the ends, so these pointers remain valid
+			std::unordered_map<uint64_t, message<T>*> m_mapConflated;
+
+			// Lane of the message currently being written, if any
+			size_t m_nCurrent = NO_LANE;
+
+			// Round robin state for the weighted lanes
+			std::array<size_t, PRIORITY_LANES> m_nDeficit{};
+			size_t m_nRoundRobin = size_t(priority::high);
+			bool m_bFreshVisit = true;
+		};
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "NetMessage.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// What a connection does with a message that arrives over its limit
+		enum class limit_action
+		{
+			pause,		// Stop reading until the message fits, so TCP pushes back on the sender
+			drop,		// Read the message past and throw it away
+			disconnect	// Close the connection
+		};
+
+		// Tokens trickle in at fRate per second, up to fBurst. A message takes as many tokens as
+		// it costs, and is let through once the bucket holds enough, or is full for messages
+		// costing more than a full bucket. The bucket may then go into debt, which later
+		// messages wait out, so big messages are still limited to the rate on average
+		class token_bucket
+		{
+		public:
+			token_bucket() = default;
+			token_bucket(double rate, double burst)
+				: fRate(rate), fBurst(std::max(burst, 1.0)), fTokens(fBurst), tLast(std::chrono::steady_clock::now())
+			{
+
+			}
+
+		public:
+			// How long until fCost can be taken, zero if it can be now
+			std::chrono::steady_clock::duration Wait(double fCost, std::chrono::steady_clock::time_point tNow)
+			{
+				Refill(tNow);
+				double fNeeded = std::min(fCost, fBurst);
+				if (fTokens >= fNeeded)
+					return std::chrono::steady_clock::duration::zero();
+
+				return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>((fNeeded - fTokens) / fRate));
+			}
+
+			void Take(double fCost)
+			{
+				fTokens -= fCost;
+			}
+
+		private:
+			void Refill(std::chrono::steady_clock::time_point tNow)
+			{
+				fTokens = std::min(fBurst, fTokens + fRate * std::chrono::duration<double>(tNow - tLast).count());
+				tLast = tNow;
+			}
+
+		private:
+			double fRate = 0.0;
+			double fBurst = 1.0;
+			double fTokens = 0.0;
+			std::chrono::steady_clock::time_point tLast;
+		};
+
+		// Limits on what one client may send, shared by every connection it applies to. A rate of
+		// zero means no limit. Bytes are counted as whole frames, header included
+		template<typename T>
+		struct rate_limit
+		{
+			double fMessagesPerSecond = 0.0;
+			double fMessageBurst = 0.0;
+			double fBytesPerSecond = 0.0;
+			double fByteBurst = 0.0;
+
+			// Limits on messages of one ID, counted in messages, on top of the ones above
+			std::unordered_map<T, std::pair<double, double>> mapPerID;
+
+			limit_action nAction = limit_action::pause;
+
+			void LimitID(T id, double fPerSecond, double fBurst)
+			{
+				mapPerID[id] = { fPerSecond, fBurst };
+			}
+		};
+
+		// The buckets of one connection. A message is only let through, and only takes tokens,
+		// if every bucket it counts against can cover it
+		template<typename T>
+		class rate_limiter
+		{
+		public:
+			explicit rate_limiter(std::shared_ptr<const rate_limit<T>> limit)
+				: m_pLimit(std::move(limit))
+			{
+				if (m_pLimit->fMessagesPerSecond > 0.0)
+					m_bucketMessages = token_bucket(m_pLimit->fMessagesPerSecond, m_pLimit->fMessageBurst);
+				if (m_pLimit->fBytesPerSecond > 0.0)
+					m_bucketBytes = token_bucket(m_pLimit->fBytesPerSecond, m_pLimit->fByteBurst);
+			}
+
+		public:
+			limit_action Action() const
+			{
+				return m_pLimit->nAction;
+			}
+
+			// Zero if the message with this header may be read now, otherwise how long it has to wait
+			std::chrono::steady_clock::duration Admit(const message_header<T>& header)
+			{
+				auto tNow = std::chrono::steady_clock::now();
+				double fBytes = double(sizeof(message_header<T>) + header.size);
+
+				token_bucket* pPerID = nullptr;
+				auto it = m_pLimit->mapPerID.find(header.id);
+				if (it != m_pLimit->mapPerID.end() && it->second.first > 0.0)
+				{
+					auto [itBucket, bNew] = m_mapPerID.try_emplace(header.id);
+					if (bNew)
+						itBucket->second = token_bucket(it->second.first, it->second.second);
+					pPerID = &itBucket->second;
+				}
+
+				auto tWait = std::chrono::steady_clock::duration::zero();
+				if (m_bucketMessages)
+					tWait = std::max(tWait, m_bucketMessages->Wait(1.0, tNow));
+				if (m_bucketBytes)
+					tWait = std::max(tWait, m_bucketBytes->Wait(fBytes, tNow));
+				if (pPerID)
+					tWait = std::max(tWait, pPerID->Wait(1.0, tNow));
+
+				if (tWait == std::chrono::steady_clock::duration::zero())
+				{
+					if (m_bucketMessages)
+						m_bucketMessages->Take(1.0);
+					if (m_bucketBytes)
+						m_bucketBytes->Take(fBytes);
+					if (pPerID)
+						pPerID->Take(1.0);
+				}
+				return tWait;
+			}
+
+		private:
+			std::shared_ptr<const rate_limit<T>> m_pLimit;
+			std::optional<token_bucket> m_bucketMessages;
+			std::optional<token_bucket> m_bucketBytes;
+			std::unordered_map<T, token_bucket> m_mapPerID;
+		};
+	}
+}
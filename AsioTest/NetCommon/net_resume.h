@@ -0,0 +1,215 @@
+#pragma once
+
+#include "NetCommon.h"
+
+#if defined(__linux__)
+#include <sys/random.h>
+#elif defined(_WIN32)
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#endif
+
+namespace olc
+{
+	namespace net
+	{
+		// Forward declare
+		template<typename T>
+		class connection;
+
+		// Fill p with nBytes from the operating system's cryptographic random number generator,
+		// for anything that mustn't be predicted from what has been seen before
+		inline bool secure_random(void* p, size_t nBytes)
+		{
+#if defined(__linux__)
+			uint8_t* pBytes = static_cast<uint8_t*>(p);
+			while (nBytes > 0)
+			{
+				ssize_t nGot = ::getrandom(pBytes, nBytes, 0);
+				if (nGot < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return false;
+				}
+				pBytes += nGot;
+				nBytes -= size_t(nGot);
+			}
+			return true;
+#elif defined(_WIN32)
+			return BCRYPT_SUCCESS(BCryptGenRandom(nullptr, static_cast<PUCHAR>(p), ULONG(nBytes), BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+			arc4random_buf(p, nBytes);
+			return true;
+#else
+			// Elsewhere random_device is the best on offer, and is usually backed by the OS
+			try
+			{
+				std::random_device rd;
+				uint8_t* pBytes = static_cast<uint8_t*>(p);
+				for (size_t i = 0; i < nBytes; i++)
+					pBytes[i] = uint8_t(rd());
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+#endif
+		}
+
+		// Given to a client once it has validated, for it to come back with after a drop. The key
+		// finds it on the server, and the secret, which can only be had from the token itself,
+		// is what proves the client was given it. Both are drawn from secure_random()
+		struct resume_token
+		{
+			uint64_t nKey = 0;
+			uint64_t nSecret = 0;
+
+			bool empty() const { return nKey == 0; }
+		};
+
+		// What a client had when its token was issued, restored when it presents it
+		template<typename T>
+		struct resume_entry
+		{
+			uint64_t nSecret = 0;
+			uint32_t nClientID = 0;
+			uint64_t nIdentity = 0;
+			uint64_t nStripeGroup = 0;
+			std::weak_ptr<connection<T>> conn;
+
+			// When the connection was first found closed, tokens last tGrace from then
+			std::optional<std::chrono::steady_clock::time_point> tDropped;
+		};
+
+		// The server's outstanding resumption tokens, found by key in O(1). Each token can be
+		// used once, the client gets a fresh one with every connection. Tokens of connections
+		// that have closed are kept for a grace period from when they were found closed. A timer
+		// on the context looks every SWEEP_EVERY, and throws out those past their grace. Used
+		// from the context thread, and the Update() thread to bind identities
+		template<typename T>
+		class resume_table : public std::enable_shared_from_this<resume_table<T>>
+		{
+		public:
+			resume_table(boost::asio::io_context& asioContext, std::chrono::steady_clock::duration tGrace)
+				: m_tGrace(tGrace), m_timerSweep(asioContext)
+			{
+
+			}
+
+			resume_table(const resume_table<T>&) = delete;
+
+		public:
+			// Start sweeping, once the table is owned by a shared_ptr
+			void Start()
+			{
+				m_timerSweep.expires_after(SWEEP_EVERY);
+				m_timerSweep.async_wait(
+					[wpSelf = this->weak_from_this()](std::error_code ec)
+					{
+						auto self = wpSelf.lock();
+						if (ec || !self)
+							return;
+
+						{
+							std::scoped_lock lock(self->muxTable);
+							self->Sweep(std::chrono::steady_clock::now());
+						}
+						self->Start();
+					});
+			}
+
+			// A fresh token for conn, or an empty one, which the client never presents, if the
+			// OS can't supply the randomness for it
+			resume_token Issue(std::weak_ptr<connection<T>> conn, uint32_t nClientID, uint64_t nIdentity, uint64_t nStripeGroup = 0)
+			{
+				std::scoped_lock lock(muxTable);
+
+				resume_token token;
+				do
+				{
+					if (!secure_random(&token, sizeof(token)))
+					{
+						std::cerr << "[SERVER] No randomness for a resume token\n";
+						return {};
+					}
+				} while (token.nKey == 0 || m_mapTokens.count(token.nKey));
+
+				m_mapTokens[token.nKey] = { token.nSecret, nClientID, nIdentity, nStripeGroup, std::move(conn), std::nullopt };
+				return token;
+			}
+
+			// The token's entry, which is used up, or nothing if it isn't one of ours or has expired
+			std::optional<resume_entry<T>> Redeem(const resume_token& token)
+			{
+				std::scoped_lock lock(muxTable);
+				auto it = m_mapTokens.find(token.nKey);
+				if (it == m_mapTokens.end() || !SecretsMatch(it->second.nSecret, token.nSecret))
+					return std::nullopt;
+
+				resume_entry<T> entry = std::move(it->second);
+				m_mapTokens.erase(it);
+
+				// The sweep may not have caught up with the connection closing, in which case
+				// it closed since the last one
+				auto tNow = std::chrono::steady_clock::now();
+				auto conn = entry.conn.lock();
+				if (!entry.tDropped && !(conn && conn->IsConnected()))
+					entry.tDropped = tNow;
+
+				if (entry.tDropped && tNow - *entry.tDropped > m_tGrace)
+					return std::nullopt;
+				return entry;
+			}
+
+			// Remember the identity the server gave the client, so it comes back with it
+			void Bind(uint64_t nKey, uint64_t nIdentity)
+			{
+				std::scoped_lock lock(muxTable);
+				auto it = m_mapTokens.find(nKey);
+				if (it != m_mapTokens.end())
+					it->second.nIdentity = nIdentity;
+			}
+
+		private:
+			// Takes as long whichever bits differ, so the time taken says nothing about the secret
+			static bool SecretsMatch(uint64_t nExpected, uint64_t nPresented)
+			{
+				volatile uint64_t nDiff = nExpected ^ nPresented;
+				return nDiff == 0;
+			}
+
+			void Sweep(std::chrono::steady_clock::time_point tNow)
+			{
+				for (auto it = m_mapTokens.begin(); it != m_mapTokens.end();)
+				{
+					auto& entry = it->second;
+					auto conn = entry.conn.lock();
+					if (conn && conn->IsConnected())
+					{
+						++it;
+						continue;
+					}
+
+					if (!entry.tDropped)
+						entry.tDropped = tNow;
+
+					if (tNow - *entry.tDropped > m_tGrace)
+						it = m_mapTokens.erase(it);
+					else
+						++it;
+				}
+			}
+
+		private:
+			static constexpr std::chrono::seconds SWEEP_EVERY{ 1 };
+
+			std::chrono::steady_clock::duration m_tGrace;
+			boost::asio::steady_timer m_timerSweep;
+
+			std::mutex muxTable;
+			std::unordered_map<uint64_t, resume_entry<T>> m_mapTokens;
+		};
+	}
+}
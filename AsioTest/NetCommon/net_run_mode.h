@@ -0,0 +1,164 @@
+#pragma once
+
+#include "NetCommon.h"
+
+#include <sstream>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace olc
+{
+	namespace net
+	{
+		// Tell the core this is a spin loop, so it eases off the pipeline (and a hyperthreaded
+		// sibling) while the thread waits
+		inline void cpu_relax()
+		{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+			_mm_pause();
+#elif defined(__aarch64__)
+			asm volatile("yield");
+#endif
+		}
+
+		// How the context thread, and whoever calls Update(), wait for something to do.
+		// By default they sleep in the kernel between events, which costs a wake up on every
+		// message. Busy polling spins on io_context::poll() and the incoming queue instead,
+		// keeping a core busy the whole time, and each spinning thread is best given one of
+		// its own
+		struct run_mode
+		{
+			bool bBusyPoll = false;
+
+			// Having spun this long without finding anything, park as usual until the next
+			// event, then go back to spinning. max() never parks
+			std::chrono::steady_clock::duration tSpinBeforePark = std::chrono::steady_clock::duration::max();
+
+			// Cores for the context thread, and the thread calling Update(), to run on. Empty
+			// leaves them wherever the OS puts them. Memory is placed on the NUMA node of the
+			// thread that first touches it, so keeping both sets on one node (see
+			// numa_node_cores()) keeps connections and their buffers there too
+			std::vector<int> vIoCores;
+			std::vector<int> vHandlerCores;
+
+			static run_mode BusyPoll(std::vector<int> vIoCores, std::vector<int> vHandlerCores,
+				std::chrono::steady_clock::duration tSpinBeforePark = std::chrono::steady_clock::duration::max())
+			{
+				run_mode mode;
+				mode.bBusyPoll = true;
+				mode.tSpinBeforePark = tSpinBeforePark;
+				mode.vIoCores = std::move(vIoCores);
+				mode.vHandlerCores = std::move(vHandlerCores);
+				return mode;
+			}
+		};
+
+		// The cores of NUMA node nNode, or none if it can't be found out
+		inline std::vector<int> numa_node_cores(int nNode)
+		{
+			std::vector<int> vCores;
+#if defined(__linux__)
+			// A list of ranges, like "0-7,16-23"
+			std::ifstream file("/sys/devices/system/node/node" + std::to_string(nNode) + "/cpulist");
+			std::string sRange;
+			while (std::getline(file, sRange, ','))
+			{
+				int nFirst = 0, nLast = 0;
+				char cDash = 0;
+				std::istringstream ss(sRange);
+				if (!(ss >> nFirst))
+					continue;
+				if (!(ss >> cDash >> nLast))
+					nLast = nFirst;
+				for (int i = nFirst; i <= nLast; i++)
+					vCores.push_back(i);
+			}
+#elif defined(_WIN32)
+			ULONGLONG nMask = 0;
+			if (nNode >= 0 && GetNumaNodeProcessorMask(UCHAR(nNode), &nMask))
+			{
+				for (int i = 0; i < 64; i++)
+					if (nMask & (ULONGLONG(1) << i))
+						vCores.push_back(i);
+			}
+#endif
+			return vCores;
+		}
+
+		// Keep the calling thread on vCores. Does nothing, and returns true, for an empty list
+		inline bool pin_this_thread(const std::vector<int>& vCores)
+		{
+			if (vCores.empty())
+				return true;
+#if defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (int nCore : vCores)
+				if (nCore >= 0 && nCore < CPU_SETSIZE)
+					CPU_SET(nCore, &set);
+			return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+			DWORD_PTR nMask = 0;
+			for (int nCore : vCores)
+				if (nCore >= 0 && nCore < int(sizeof(DWORD_PTR) * 8))
+					nMask |= DWORD_PTR(1) << nCore;
+			return nMask && SetThreadAffinityMask(GetCurrentThread(), nMask) != 0;
+#else
+			return false;
+#endif
+		}
+
+		// The body of a context thread: run the context until it is stopped, as mode says
+		inline void run_context(boost::asio::io_context& asioContext, const run_mode& mode)
+		{
+			if (!pin_this_thread(mode.vIoCores))
+				std::cerr << "[NET] Could not pin the context thread\n";
+
+			if (!mode.bBusyPoll)
+			{
+				asioContext.run();
+				return;
+			}
+
+			// poll() runs whatever is ready, checking the sockets without blocking, so looping
+			// on it picks events up as soon as they land. Once idle for tSpinBeforePark it
+			// falls back on run_one(), which sleeps until the next one
+			bool bIdle = false;
+			std::chrono::steady_clock::time_point tIdleSince;
+			while (!asioContext.stopped())
+			{
+				if (asioContext.poll() > 0)
+				{
+					bIdle = false;
+					continue;
+				}
+
+				if (mode.tSpinBeforePark == std::chrono::steady_clock::duration::max())
+				{
+					cpu_relax();
+					continue;
+				}
+
+				auto tNow = std::chrono::steady_clock::now();
+				if (!bIdle)
+				{
+					bIdle = true;
+					tIdleSince = tNow;
+				}
+				else if (tNow - tIdleSince >= mode.tSpinBeforePark)
+				{
+					asioContext.run_one();
+					bIdle = false;
+				}
+				else
+					cpu_relax();
+			}
+		}
+	}
+}
@@ -4,6 +4,17 @@
 #include "net_tsqueue.h"
 #include "NetMessage.h"
 #include "net_connection.h"
+#include "net_connection_pool.h"
+#include "net_capture.h"
+#include "net_trace.h"
+#include "net_cluster.h"
+#include "net_tls.h"
+#include "net_ratelimit.h"
+#include "net_connlist.h"
+#include "net_body_pool.h"
+#include "net_fixed.h"
+#include "net_spool.h"
+#include "net_run_mode.h"
 
 namespace olc
 {
@@ -14,7 +25,8 @@ namespace olc
 		{
 		public:
 			server_interface(uint16_t port)
-				: m_asioAcceptor(m_asioContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port))
+				: m_asioAcceptor(m_asioContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
+				m_pConnectionPool(std::make_shared<connection_pool<T>>(m_asioContext, m_qMessagesIn))
 			{
 
 			}
@@ -22,15 +34,33 @@ namespace olc
 			virtual ~server_interface()
 			{
 				Stop();
+
+				// Connections own sockets of the context, so let them go while it still exists
+				m_qMessagesIn.clear();
+				m_vBatch.clear();
+				m_connections.Clear();
+				m_qResumed.clear();
+				m_mapIdentities.clear();
 			}
 
 			bool Start()
 			{
+#if defined(OLC_NET_IO_URING) && defined(__linux__)
+				if (!io_uring_available())
+				{
+					std::cerr << "[SERVER] Built with OLC_NET_IO_URING, but io_uring can't be set up here\n";
+					return false;
+				}
+#endif
 				try
 				{
-					WaitForClientConnection();
+					for (size_t i = 0; i < m_nPendingAccepts; i++)
+						WaitForClientConnection();
 
-					m_threadContext = std::thread([this]() {m_asioContext.run(); });
+					if (m_pCluster)
+						m_pCluster->Start();
+
+					m_threadContext = std::thread([this]() { run_context(m_asioContext, m_runMode); });
 				}
 				catch (const std::exception& e)
 				{	// Somthing prohibited the server from listening
@@ -54,6 +84,308 @@ namespace olc
 				std::cout << "[SERVER] Stopped\n";
 			}
 
+			// Construct nCount connections ahead of time, so an accept storm only has to hand
+			// out pooled objects. nReserveBytes sizes each connection's receive buffer
+			void PrewarmConnections(size_t nCount, size_t nReserveBytes = 0)
+			{
+				m_pConnectionPool->Prewarm(nCount, nReserveBytes);
+			}
+
+			// Keep nCount accepts waiting on the listening socket at once, so a burst of
+			// connections doesn't queue up behind one accept at a time. Call before Start()
+			void SetPendingAccepts(size_t nCount)
+			{
+				m_nPendingAccepts = std::max(nCount, size_t(1));
+			}
+
+			// Offer per-frame CRC32C checksums to connecting clients. Only clients that ask for
+			// them too will use them. Affects connections accepted from now on
+			void EnableChecksums(bool bEnable)
+			{
+				if (bEnable)
+					m_nFeatures |= FEATURE_CHECKSUM;
+				else
+					m_nFeatures &= ~FEATURE_CHECKSUM;
+			}
+
+			// Sample one in every nSampleEvery messages, in and out, and time each stage they pass
+			// through. Affects connections accepted from now on. See DumpTrace()
+			void EnableTracing(size_t nSampleEvery = 100, size_t nCapacity = 65536)
+			{
+				m_pTracer = std::make_shared<message_tracer>(nSampleEvery, nCapacity);
+			}
+
+			// Write the most recent traced stages to sPath, for chrome://tracing or ui.perfetto.dev
+			bool DumpTrace(const std::string& sPath)
+			{
+				return m_pTracer && m_pTracer->Dump(sPath);
+			}
+
+			// Limit what each client may send, so one flooding client can't take handler time
+			// from everyone else. Every client gets its own buckets, filled to the same limits.
+			// Affects connections accepted from now on
+			void SetRateLimit(const rate_limit<T>& limit)
+			{
+				m_pRateLimit = std::make_shared<const rate_limit<T>>(limit);
+			}
+
+			void DisableRateLimit()
+			{
+				m_pRateLimit.reset();
+			}
+
+			// Tune every client's socket for the kind of traffic it will carry, see socket_profile.
+			// Affects connections accepted from now on. Each connection's GetSocketReport()
+			// shows what took effect
+			void SetSocketProfile(socket_profile nProfile)
+			{
+				SetSocketTuning(socket_tuning::For(nProfile));
+			}
+
+			void SetSocketTuning(const socket_tuning& tuning)
+			{
+				m_pSocketTuning = std::make_shared<const socket_tuning>(tuning);
+			}
+
+			// Choose how the context thread, and Update(..., true), wait for work, and which
+			// cores they run on, see run_mode. Call before Start()
+			void SetRunMode(const run_mode& mode)
+			{
+				m_runMode = mode;
+			}
+
+			// Disconnect any client that sends one of these fixed layout messages (see
+			// fixed_payload) with a body of any other size. Affects connections accepted from now on
+			template<auto... IDs>
+			void DeclareFixedPayloads()
+			{
+				m_pFixedLayout = fixed_layout<T>::template Of<IDs...>();
+			}
+
+#ifdef OLC_NET_TLS
+			// Serve every client over TLS, with the certificate chain and private key in the given
+			// PEM files. Clients that reconnect resume their session from a ticket, skipping the
+			// full handshake. Affects connections accepted from now on
+			bool EnableTLS(const std::string& sCertChainFile, const std::string& sKeyFile)
+			{
+				try
+				{
+					auto ctx = std::make_unique<boost::asio::ssl::context>(boost::asio::ssl::context::tls_server);
+					ctx->set_options(boost::asio::ssl::context::default_workarounds |
+						boost::asio::ssl::context::no_sslv2 | boost::asio::ssl::context::no_sslv3 |
+						boost::asio::ssl::context::no_tlsv1 | boost::asio::ssl::context::no_tlsv1_1);
+					ctx->use_certificate_chain_file(sCertChainFile);
+					ctx->use_private_key_file(sKeyFile, boost::asio::ssl::context::pem);
+					m_pTLSContext = std::move(ctx);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "[SERVER] TLS Exception: " << e.what() << "\n";
+					return false;
+				}
+				return true;
+			}
+#endif
+
+			// Make this server node nNodeID (1-255) of a cluster, listening for other nodes on
+			// nPeerPort. Client IDs are prefixed with the node ID so they are unique cluster wide,
+			// and MessageClient()/MessageAllClients() reach clients on other nodes. Call before Start()
+			bool EnableCluster(uint8_t nNodeID, uint16_t nPeerPort)
+			{
+				try
+				{
+					m_pCluster = std::make_unique<cluster_node<T>>(m_asioContext, m_qMessagesIn, nNodeID, nPeerPort);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "[SERVER] Cluster Exception: " << e.what() << "\n";
+					return false;
+				}
+
+				nIDCounter = (uint32_t(nNodeID) << CLUSTER_NODE_SHIFT) | (nIDCounter & ((1u << CLUSTER_NODE_SHIFT) - 1));
+				return true;
+			}
+
+			// Link to another node of the cluster. Every node must be linked to every other,
+			// either end may be the one to call this. The other end has to allow this one, see
+			// AllowPeer(), unless it has dialed it too
+			bool AddPeer(const std::string& host, const uint16_t port)
+			{
+				return m_pCluster && m_pCluster->Connect(host, port);
+			}
+
+			// Accept links from other nodes at host. Peer links are trusted with whatever they
+			// relay, so nothing else may link to the peer port
+			bool AllowPeer(const std::string& host)
+			{
+				if (!m_pCluster)
+					return false;
+
+				try
+				{
+					boost::asio::ip::tcp::resolver resolver(m_asioContext);
+					for (auto& endpoint : resolver.resolve(host, ""))
+						m_pCluster->AllowPeer(endpoint.endpoint().address());
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "[SERVER] AllowPeer Exception: " << e.what() << "\n";
+					return false;
+				}
+				return true;
+			}
+
+			// Give clients that ask for it a resume_token after they validate. One that drops and
+			// reconnects within tGrace presents its token in its first frame instead of validating
+			// again, and is given back its old ID, and its identity (see SetClientIdentity()),
+			// along with whatever was spooled for it. Affects connections accepted from now on
+			void EnableResumption(std::chrono::steady_clock::duration tGrace = std::chrono::minutes(5))
+			{
+				m_pResume = std::make_shared<resume_table<T>>(m_asioContext, tGrace);
+				m_pResume->Start();
+				m_nFeatures |= FEATURE_RESUME;
+			}
+
+			// Keep what is owed to clients that drop on disk, in memory mapped segments under
+			// sDirectory, until they come back under the same identity (see SetClientIdentity()).
+			// It is then streamed to them no more than nReplayBudget bytes at a time. A client
+			// owed more than nMaxBytes is given up on. Call from the Update() thread
+			bool EnableSpool(const std::string& sDirectory, size_t nReplayBudget = 1024 * 1024,
+				size_t nMaxBytes = 256 * 1024 * 1024, size_t nSegmentSize = 16 * 1024 * 1024)
+			{
+				try
+				{
+					std::filesystem::create_directories(sDirectory);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "[SERVER] Spool Exception: " << e.what() << "\n";
+					return false;
+				}
+
+				m_pSpoolConfig = std::make_unique<spool_config>(spool_config{ sDirectory, nReplayBudget, nMaxBytes, nSegmentSize });
+				return true;
+			}
+
+			// Stop spooling. Whatever is already spooled stays until its client returns
+			void DisableSpool()
+			{
+				m_pSpoolConfig.reset();
+			}
+
+			// Tie a client to an identity that outlives its connection, such as an account, once
+			// it has proved it. If a client with the same identity dropped, this one takes its
+			// place, and is sent everything spooled for it first. Call from the Update() thread
+			void SetClientIdentity(std::shared_ptr<connection<T>> client, uint64_t nIdentity)
+			{
+				auto& ident = m_mapIdentities[nIdentity];
+				if (ident.client == client)
+					return;
+
+				// Whatever the one before left unwritten belongs to this one now
+				if (ident.client && !ident.client->IsConnected())
+					SpoolFor(nIdentity);
+
+				client->m_nIdentity = nIdentity;
+				ident.client = client;
+				if (m_pResume && !client->m_resumeToken.empty())
+					m_pResume->Bind(client->m_resumeToken.nKey, nIdentity);
+				if (ident.spool)
+					ident.spool->Replay(m_asioContext, client);
+			}
+
+			// Send a message to whichever client holds nIdentity. If it has dropped, the message
+			// is spooled for when it returns. Returns false if it was neither sent nor spooled
+			bool MessageIdentity(uint64_t nIdentity, message<T> msg, priority nPriority = priority::normal)
+			{
+				auto it = m_mapIdentities.find(nIdentity);
+				if (it == m_mapIdentities.end())
+					return false;
+
+				auto& ident = it->second;
+				if (ident.client && !ident.client->IsConnected())
+					SpoolFor(nIdentity);
+
+				if (ident.spool && ident.spool->Delivered())
+					ident.spool.reset();
+
+				if (ident.spool)
+				{
+					if (ident.spool->Append(std::move(msg), nPriority))
+						return true;
+
+					std::cout << "[SERVER] Spool Full, Identity " << nIdentity << " Abandoned\n";
+					ident.spool.reset();
+					return false;
+				}
+
+				if (!ident.client)
+					return false;
+
+				ident.client->Send(std::move(msg), nPriority);
+				return true;
+			}
+
+			// Forget an identity for good, along with anything spooled for it
+			void ForgetIdentity(uint64_t nIdentity)
+			{
+				m_mapIdentities.erase(nIdentity);
+			}
+
+			// Start recording every message Update() dispatches to an append-only log at sPath,
+			// written in memory mapped segments of nSegmentSize bytes. Call from the Update() thread
+			bool EnableCapture(const std::string& sPath, size_t nSegmentSize = 64 * 1024 * 1024)
+			{
+				try
+				{
+					m_pCapture = std::make_unique<capture_writer<T>>(sPath, nSegmentSize);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "[SERVER] Capture Exception: " << e.what() << "\n";
+					return false;
+				}
+				return true;
+			}
+
+			void DisableCapture()
+			{
+				m_pCapture.reset();
+			}
+
+			// Feed a capture straight into OnMessage, as fast as it can be read. Each captured
+			// connection ID gets a stand-in connection that is never connected, so replies
+			// sent to it go nowhere. Returns the number of messages replayed
+			size_t Replay(const std::string& sPath)
+			{
+				size_t nMessageCount = 0;
+				try
+				{
+					capture_reader<T> reader(sPath);
+					capture_record<T> record;
+					std::unordered_map<uint32_t, std::shared_ptr<connection<T>>> mapClients;
+
+					while (reader.Next(record))
+					{
+						auto& client = mapClients[record.nConnectionID];
+						if (!client)
+						{
+							client = std::make_shared<connection<T>>(connection<T>::owner::server,
+								m_asioContext, boost::asio::ip::tcp::socket(m_asioContext), m_qMessagesIn);
+							client->id = record.nConnectionID;
+						}
+
+						OnMessage(client, record.msg);
+						nMessageCount++;
+					}
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "[SERVER] Replay Exception: " << e.what() << "\n";
+				}
+				return nMessageCount;
+			}
+
 			// Async - Instrcut asio to wait for connection
 			void WaitForClientConnection()
 			{
@@ -67,30 +399,41 @@ namespace olc
 							// Display some useful(?) information
 							std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << "\n";
 
-							// Create a new connection to handle this client 
-							std::shared_ptr<connection<T>> newconn =
-								std::make_shared<connection<T>>(connection<T>::owner::server,
-									m_asioContext, std::move(socket), m_qMessagesIn);
+							// Take a connection from the pool to handle this client
+							std::shared_ptr<connection<T>> newconn = m_pConnectionPool->Acquire(std::move(socket));
+							newconn->RequestFeatures(m_nFeatures);
+							newconn->SetTracer(m_pTracer);
+							newconn->SetRateLimit(m_pRateLimit);
+							newconn->SetBodyPool(m_pBodyPool);
+							newconn->SetFixedLayout(m_pFixedLayout);
+							newconn->SetResumeTable(m_pResume);
+							newconn->SetSocketTuning(m_pSocketTuning);
+#ifdef OLC_NET_TLS
+							if (m_pTLSContext)
+								newconn->EnableTLS(*m_pTLSContext);
+#endif
 
 
 							// Give the user server a chance to deny connection
 							if (OnClientConnect(newconn))
 							{
-								// Connection allowed, so add to container of new connections
-								m_deqConnections.push_back(std::move(newconn));
+								// Connection allowed, so add to container of new connections. Accepts that
+								// complete together join it in one go, when the first one's publish runs
+								if (m_connections.Add(newconn))
+									boost::asio::post(m_asioContext, [this]() { m_connections.Publish(); });
 
 								// And very important! Issue a task to the connection's
 								// asio context to sit and wait for bytes to arrive!
-								m_deqConnections.back()->ConnectToClient(this, nIDCounter++);
+								newconn->ConnectToClient(this, NextClientID());
 
-								std::cout << "[" << m_deqConnections.back()->GetID() << "] Connection Approved\n";
+								std::cout << "[" << newconn->GetID() << "] Connection Approved\n";
 							}
 							else
 							{
 								std::cout << "[-----] Connection Denied\n";
 
 								// Connection will go out of scope with no pending tasks, so will
-								// get destroyed automagically due to the wonder of smart pointers
+								// get returned to the pool automagically due to the wonder of smart pointers
 							}
 						}
 						else
@@ -106,56 +449,110 @@ namespace olc
 			}
 
 			// Send a message to a specific client
-			void MessageClient(std::shared_ptr<connection<T>> client, const  message<T>& msg)
+			void MessageClient(std::shared_ptr<connection<T>> client, message<T> msg, priority nPriority = priority::normal)
 			{
 				// Check client is connected...
 				if (client && client->IsConnected())
 				{
 					// ... and post the message via the connection
-					client->Send(msg);
+					client->Send(std::move(msg), nPriority);
 				}
 				else
 				{
-					OnClientDisconnect(client);
+					// A client that resumed on another connection hasn't really gone
+					if (!client || !client->m_bSuperseded)
+						OnClientDisconnect(client);
+					OnClientLost(client);
+					m_connections.Remove({ client });
 					client.reset();
-					m_deqConnections.erase(
-						std::remove(m_deqConnections.begin(), m_deqConnections.end(), client), m_deqConnections.end()
-					);
 				}
 			}
 
-			// Send message to all clients
-			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+			// Send a message to a client by ID, which may be connected to another node of the cluster
+			void MessageClient(uint32_t nClientID, const message<T>& msg, priority nPriority = priority::normal)
+			{
+				if (m_pCluster && NodeOfClient(nClientID) != m_pCluster->GetNodeID())
+				{
+					m_pCluster->Relay(nClientID, msg, nPriority);
+					return;
+				}
+
+				// A client that resumed may still be listed under its old connection too, so
+				// prefer the one that is connected
+				auto clients = m_connections.Snapshot();
+				auto it = std::find_if(clients->begin(), clients->end(),
+					[nClientID](const auto& client) { return client && client->GetID() == nClientID && client->IsConnected(); });
+				if (it == clients->end())
+					it = std::find_if(clients->begin(), clients->end(),
+						[nClientID](const auto& client) { return client && client->GetID() == nClientID; });
+				if (it != clients->end())
+					MessageClient(*it, msg, nPriority);
+			}
+
+			// Send message to all clients, on every node of the cluster. Messages for other nodes
+			// are batched up and sent at the end of Update()
+			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr, priority nPriority = priority::normal)
+			{
+				if (m_pCluster)
+					m_pCluster->QueueBroadcast(msg, nPriority);
+
+				MessageLocalClients(msg, pIgnoreClient, nPriority);
+			}
+
+			// Send message to all clients connected to this server only
+			void MessageLocalClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr, priority nPriority = priority::normal)
 			{
-				bool bInvalidClientExists = false;
+				std::vector<std::shared_ptr<connection<T>>> vGone;
 
-				for (auto& client : m_deqConnections)
+				// Works through the list as it stands, while accepts carry on publishing new versions
+				auto clients = m_connections.Snapshot();
+				for (auto& client : *clients)
 				{
 					// Check client is connected...
 					if (client && client->IsConnected())
 					{
 						if (client != pIgnoreClient)
-							client->Send(msg);
+							client->Send(msg, nPriority);
 					}
 					else
 					{
-						OnClientDisconnect(client);
-						client.reset();
-						bInvalidClientExists = true;
+						if (!client || !client->m_bSuperseded)
+							OnClientDisconnect(client);
+						OnClientLost(client);
+						vGone.push_back(client);
 					}
 				}
 
 				// call once for optimization
-				if (bInvalidClientExists)
-					m_deqConnections.erase(
-						std::remove(m_deqConnections.begin(), m_deqConnections.end(), nullptr), m_deqConnections.end()
-					);
+				m_connections.Remove(vGone);
 			}
 
 			// Force server to respond to incoming messages
 			void Update(size_t nMaxMessages = -1, bool bWait = false)
 			{
-				if (bWait) m_qMessagesIn.wait();
+				// Whichever thread drives Update() is the handler thread
+				if (!m_runMode.vHandlerCores.empty() && m_idHandlerThread != std::this_thread::get_id())
+				{
+					m_idHandlerThread = std::this_thread::get_id();
+					if (!pin_this_thread(m_runMode.vHandlerCores))
+						std::cerr << "[SERVER] Could not pin the Update() thread\n";
+				}
+
+				if (bWait)
+				{
+					if (m_runMode.bBusyPoll)
+						m_qMessagesIn.wait(m_runMode.tSpinBeforePark);
+					else
+						m_qMessagesIn.wait();
+				}
+
+				// Clients that resumed get their identity back, and with it anything spooled
+				while (!m_qResumed.empty())
+				{
+					auto client = m_qResumed.pop_front();
+					if (client->GetIdentity() != 0)
+						SetClientIdentity(client, client->GetIdentity());
+				}
 
 				// Process as many messages as you coan up to the value
 				size_t nMessageCount = 0;
@@ -163,11 +560,220 @@ namespace olc
 				{
 					auto msg = m_qMessagesIn.pop_front();
 
+					// Traffic relayed from other nodes goes straight on to the clients it is for
+					if (m_pCluster && m_pCluster->IsPeer(msg.remote))
+					{
+						m_pCluster->Receive(msg.remote, msg.msg,
+							[this](uint32_t nClientID, const message<T>& msgRelayed, priority nPriority)
+							{
+								if (nClientID == 0)
+									MessageLocalClients(msgRelayed, nullptr, nPriority);
+								else
+									MessageClient(nClientID, msgRelayed, nPriority);
+							});
+						nMessageCount++;
+						continue;
+					}
+
+					// Record it exactly as the handler is about to see it
+					if (m_pCapture)
+						m_pCapture->Record(msg.remote ? msg.remote->GetID() : 0, msg.msg);
+
+					nMessageCount++;
+
+					// Batches are handled once everything has been drained
+					if (m_bBatchDispatch)
+					{
+						m_vBatch.push_back(std::move(msg));
+						continue;
+					}
+
 					// Psss to message handler
+					msg.msg.trace.Stamp(trace_stage::dispatch);
 					OnMessage(msg.remote, msg.msg);
+					msg.msg.trace.Stamp(trace_stage::handled);
+					CommitTrace(msg);
 
-					nMessageCount++;
+					// Its body can take the next message a connection reads
+					m_pBodyPool->Release(std::move(msg.msg.body));
 				}
+
+				if (!m_vBatch.empty())
+					DispatchBatches();
+
+				// Anything broadcast while handling those goes out to the other nodes in one go
+				if (m_pCluster)
+					m_pCluster->Flush();
+			}
+
+			// Have Update() gather up what it drains and hand it over in batches of the same ID,
+			// through OnMessageBatch(), rather than one message at a time through OnMessage()
+			void EnableBatchDispatch(bool bEnable)
+			{
+				m_bBatchDispatch = bEnable;
+			}
+
+		private:
+			// Group the drained messages by ID, keeping the order within each ID, and pass each
+			// group to the handler. Order between different IDs is not kept
+			void DispatchBatches()
+			{
+				std::stable_sort(m_vBatch.begin(), m_vBatch.end(),
+					[](const owned_message<T>& a, const owned_message<T>& b) { return a.msg.header.id < b.msg.header.id; });
+
+				size_t nStart = 0;
+				while (nStart < m_vBatch.size())
+				{
+					size_t nEnd = nStart + 1;
+					while (nEnd < m_vBatch.size() && m_vBatch[nEnd].msg.header.id == m_vBatch[nStart].msg.header.id)
+						nEnd++;
+
+					message_batch<T> batch{ m_vBatch.data() + nStart, nEnd - nStart };
+					for (auto& msg : batch)
+						msg.msg.trace.Stamp(trace_stage::dispatch);
+
+					OnMessageBatch(m_vBatch[nStart].msg.header.id, batch);
+
+					for (auto& msg : batch)
+					{
+						msg.msg.trace.Stamp(trace_stage::handled);
+						CommitTrace(msg);
+						m_pBodyPool->Release(std::move(msg.msg.body));
+					}
+					nStart = nEnd;
+				}
+
+				// Keep the capacity for next time
+				m_vBatch.clear();
+			}
+
+			// Called by a stream of a striping client as it is let in. The client's primary stream
+			// is given a new group (or, resuming, its old one back) and leads it, and the rest take
+			// on its ID and share its rate limit. Returns false for a group that wasn't issued
+			// here, or has no streams left. Runs on the context thread
+			bool JoinStripe(std::shared_ptr<connection<T>> client, bool bLead)
+			{
+				// A stream naming no group is a client's primary, and gets a new one to lead
+				if (client->m_nStripeGroup == 0)
+				{
+					do
+					{
+						if (!secure_random(&client->m_nStripeGroup, sizeof(uint64_t)))
+							return false;
+					} while (client->m_nStripeGroup == 0 || m_mapStripes.count(client->m_nStripeGroup));
+					bLead = true;
+				}
+
+				// Any other group must be one issued here, bar that of a stream resuming with its
+				// token, which the token vouches for
+				auto it = m_mapStripes.find(client->m_nStripeGroup);
+				auto group = it != m_mapStripes.end() ? it->second.lock() : nullptr;
+				if (!group && !bLead)
+					return false;
+
+				if (bLead)
+				{
+					if (!group)
+					{
+						group = std::make_shared<stripe_group<T>>();
+						m_mapStripes[client->m_nStripeGroup] = group;
+					}
+					group->nClientID = client->id;
+					group->pLimiter = client->m_pLimiter;
+				}
+				else
+				{
+					client->id = group->nClientID;
+					client->m_pLimiter = group->pLimiter;
+				}
+				client->m_pStripe = group;
+
+				// Groups go once their last stream has, so sweep them out now and then
+				if (m_mapStripes.size() >= m_nStripeSweepAt)
+				{
+					std::erase_if(m_mapStripes, [](const auto& entry) { return entry.second.expired(); });
+					m_nStripeSweepAt = std::max(size_t(64), 2 * m_mapStripes.size());
+				}
+				return true;
+			}
+
+			// The ID for the next client accepted. In a cluster the node's ID fills the bits from
+			// CLUSTER_NODE_SHIFT up, so only the bits below count, wrapping round when they run
+			// out. The low bits are never all zero, and once they have wrapped, IDs still held by
+			// a connection are passed over. Runs on the context thread
+			uint32_t NextClientID()
+			{
+				const uint32_t nMask = m_pCluster ? (1u << CLUSTER_NODE_SHIFT) - 1 : UINT32_MAX;
+				const uint32_t nNode = nIDCounter & ~nMask;
+				auto clients = m_connections.Snapshot();
+
+				while (true)
+				{
+					uint32_t nLow = nIDCounter & nMask;
+					nIDCounter = nNode | ((nLow + 1) & nMask);
+					if (nLow == nMask)
+						m_bIDsWrapped = true;
+					if (nLow == 0)
+						continue;
+
+					uint32_t nID = nNode | nLow;
+					if (!m_bIDsWrapped || std::none_of(clients->begin(), clients->end(),
+						[nID](const auto& client) { return client && client->GetID() == nID; }))
+						return nID;
+				}
+			}
+
+			// Called by a connection that has taken over from an earlier one with its token
+			void ClientResumed(std::shared_ptr<connection<T>> client)
+			{
+				m_qResumed.push_back(client);
+				OnClientResumed(client);
+			}
+
+			// A client has gone, so if it had an identity, start keeping what it is owed
+			void OnClientLost(const std::shared_ptr<connection<T>>& client)
+			{
+				if (!client || client->m_nIdentity == 0)
+					return;
+
+				auto it = m_mapIdentities.find(client->m_nIdentity);
+				if (it != m_mapIdentities.end() && it->second.client == client)
+					SpoolFor(it->first);
+			}
+
+			// Move the identity's dropped client, and what it never wrote, into a spool
+			void SpoolFor(uint64_t nIdentity)
+			{
+				auto& ident = m_mapIdentities[nIdentity];
+				auto dropped = std::move(ident.client);
+				if (!m_pSpoolConfig)
+					return;
+
+				// Still replaying to it, so carry on with the same spool once it is back
+				if (ident.spool && ident.spool->Delivered())
+					ident.spool.reset();
+
+				if (!ident.spool)
+				{
+					try
+					{
+						std::string sPath = (std::filesystem::path(m_pSpoolConfig->sDirectory) / ("spool_" + std::to_string(nIdentity))).string();
+						ident.spool = std::make_shared<client_spool<T>>(sPath, *m_pSpoolConfig);
+					}
+					catch (const std::exception& e)
+					{
+						std::cerr << "[SERVER] Spool Exception: " << e.what() << "\n";
+						return;
+					}
+				}
+
+				ident.spool->Capture(m_asioContext, std::move(dropped));
+			}
+
+			void CommitTrace(const owned_message<T>& msg)
+			{
+				if (m_pTracer)
+					m_pTracer->Commit(msg.msg.trace, msg.remote ? msg.remote->GetID() : 0, uint32_t(msg.msg.header.id));
 			}
 
 		protected:
@@ -188,28 +794,108 @@ namespace olc
 			{
 
 			}
+
+			// Called with every message of one ID drained by an Update(), when batch dispatch is
+			// on. Handlers that can work through a whole array of inputs at once override this,
+			// the rest still get their messages one by one
+			virtual void OnMessageBatch(T id, message_batch<T>& batch)
+			{
+				for (auto& msg : batch)
+					OnMessage(msg.remote, msg.msg);
+			}
 		public:
 			// Called when a client is validated
 			virtual void OnClientValidated(std::shared_ptr<connection<T>> client)
 			{
 
 			}
+
+			// Called instead of OnClientValidated() when a client comes back with a resume_token.
+			// It already has its old ID, its identity is restored on the next Update()
+			virtual void OnClientResumed(std::shared_ptr<connection<T>> client)
+			{
+
+			}
 		protected:
 			// Thread Safe Queue for incoming message packets
 			tsqueue<owned_message<T>> m_qMessagesIn;
 
-			// Container of active validated connection
-			std::deque<std::shared_ptr<connection<T>>> m_deqConnections;
+			// Container of active validated connection, snapshotted by whoever walks it
+			connection_list<T> m_connections;
 
 			// Order of declaration si important - it is also the order of initialisation
 			boost::asio::io_context m_asioContext;
 			std::thread m_threadContext;
 
+			// How the context thread and Update() wait, and the thread Update() last pinned
+			run_mode m_runMode;
+			std::thread::id m_idHandlerThread;
+
 			// These things need an asio context
 			boost::asio::ip::tcp::acceptor m_asioAcceptor;
 
-			// Clients will be identified in the "wider system" via an ID
+			// Recycled connection objects, handed out by the accept handler
+			std::shared_ptr<connection_pool<T>> m_pConnectionPool;
+
+			// Clients will be identified in the "wider system" via an ID, see NextClientID()
 			uint32_t nIDCounter = 10000;
+			bool m_bIDsWrapped = false;
+
+			// Accepts kept outstanding on the acceptor
+			size_t m_nPendingAccepts = 1;
+
+			// Optional features offered to every client
+			uint32_t m_nFeatures = FEATURE_STRIPE;
+
+			// Striping clients' stream groups, by the ID they send
+			std::unordered_map<uint64_t, std::weak_ptr<stripe_group<T>>> m_mapStripes;
+			size_t m_nStripeSweepAt = 64;
+
+			// Optional recording of dispatched messages
+			std::unique_ptr<capture_writer<T>> m_pCapture;
+
+			// Optional sampling of per-stage message timings
+			std::shared_ptr<message_tracer> m_pTracer;
+
+			// Optional limit on what each client may send
+			std::shared_ptr<const rate_limit<T>> m_pRateLimit;
+
+			// Bodies of dispatched messages, recycled for connections to read into
+			std::shared_ptr<body_pool> m_pBodyPool = std::make_shared<body_pool>();
+
+			// Options for every accepted socket, if any
+			std::shared_ptr<const socket_tuning> m_pSocketTuning;
+
+			// Sizes of the fixed layout messages clients may send, if declared
+			std::shared_ptr<const fixed_layout<T>> m_pFixedLayout;
+
+			// Clients by the identity they were given, and what is spooled for those away
+			struct identity_slot
+			{
+				std::shared_ptr<connection<T>> client;
+				std::shared_ptr<client_spool<T>> spool;
+			};
+			std::unordered_map<uint64_t, identity_slot> m_mapIdentities;
+			std::unique_ptr<spool_config> m_pSpoolConfig;
+
+			// Outstanding resumption tokens, if enabled, and clients that resumed since the last Update()
+			std::shared_ptr<resume_table<T>> m_pResume;
+			tsqueue<std::shared_ptr<connection<T>>> m_qResumed;
+
+			// Connections report resumptions through ClientResumed()
+			friend class connection<T>;
+
+			// Links to the other servers, when running as part of a cluster
+			std::unique_ptr<cluster_node<T>> m_pCluster;
+
+#ifdef OLC_NET_TLS
+			// Shared by every TLS connection, if enabled
+			std::unique_ptr<boost::asio::ssl::context> m_pTLSContext;
+#endif
+
+			// Messages drained by Update() waiting to be dispatched in batches, if enabled
+			bool m_bBatchDispatch = false;
+			std::vector<owned_message<T>> m_vBatch;
 		};
 	}
 }
\ No newline at end of file
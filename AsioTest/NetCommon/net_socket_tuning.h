@@ -0,0 +1,337 @@
+#pragma once
+
+#include "NetCommon.h"
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace olc
+{
+	namespace net
+	{
+		// Named sets of socket options, for the usual kinds of connection
+		enum class socket_profile
+		{
+			system,			// Leave everything as the OS has it
+			low_latency,	// Small messages that must go out now: no Nagle, quick ACKs, busy polling
+			bulk,			// Large transfers: kernel buffers sized to the link as it is observed
+			fan_out			// Very many mostly idle connections: small buffers to bound kernel memory
+		};
+
+		// For command lines: "system", "low_latency", "bulk" or "fan_out"
+		inline bool parse_socket_profile(const std::string& sName, socket_profile& nProfile)
+		{
+			static const std::pair<const char*, socket_profile> profiles[] = {
+				{ "system", socket_profile::system }, { "low_latency", socket_profile::low_latency },
+				{ "bulk", socket_profile::bulk }, { "fan_out", socket_profile::fan_out } };
+
+			for (auto& [sProfile, nValue] : profiles)
+			{
+				if (sName == sProfile)
+				{
+					nProfile = nValue;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Socket options applied to a connection when it connects. Buffer sizes of zero, and
+		// anything the platform doesn't have, leave the OS default in place
+		struct socket_tuning
+		{
+			socket_profile nProfile = socket_profile::system;
+
+			bool bNoDelay = false;
+			bool bQuickAck = false;			// Linux only
+			int nBusyPollMicros = 0;		// Linux only, raising it may need CAP_NET_ADMIN
+			bool bKeepAlive = false;
+			int nKeepAliveIdleSeconds = 0;	// Linux only, zero keeps the OS default
+			int nRecvBuffer = 0;
+			int nSendBuffer = 0;
+
+			// Resize the kernel buffers every tAdaptInterval to twice the bandwidth-delay product
+			// seen over the last interval, between nMinBuffer and nMaxBuffer. Needs the round trip
+			// time from TCP_INFO, so only adapts on Linux
+			bool bAdaptiveBuffers = false;
+			int nMinBuffer = 64 * 1024;
+			int nMaxBuffer = 16 * 1024 * 1024;
+			std::chrono::steady_clock::duration tAdaptInterval = std::chrono::seconds(1);
+
+			static socket_tuning For(socket_profile nProfile)
+			{
+				socket_tuning tuning;
+				tuning.nProfile = nProfile;
+				switch (nProfile)
+				{
+				case socket_profile::system:
+					break;
+
+				case socket_profile::low_latency:
+					tuning.bNoDelay = true;
+					tuning.bQuickAck = true;
+					tuning.nBusyPollMicros = 50;
+					tuning.bKeepAlive = true;
+					tuning.nKeepAliveIdleSeconds = 30;
+					break;
+
+				case socket_profile::bulk:
+					// Frames are written whole, so Nagle has nothing to coalesce
+					tuning.bNoDelay = true;
+					tuning.bKeepAlive = true;
+					tuning.bAdaptiveBuffers = true;
+					break;
+
+				case socket_profile::fan_out:
+					tuning.bNoDelay = true;
+					tuning.bKeepAlive = true;
+					tuning.nKeepAliveIdleSeconds = 60;
+					tuning.nRecvBuffer = 32 * 1024;
+					tuning.nSendBuffer = 64 * 1024;
+					break;
+				}
+				return tuning;
+			}
+		};
+
+		// The settings a connection's socket actually ended up with, as the OS reports them
+		// (Linux doubles buffer sizes for its own bookkeeping), and what the link looked like
+		// when the buffers were last adapted
+		struct socket_report
+		{
+			socket_profile nProfile = socket_profile::system;
+			bool bNoDelay = false;
+			bool bQuickAck = false;
+			bool bKeepAlive = false;
+			int nBusyPollMicros = 0;
+			int nRecvBuffer = 0;
+			int nSendBuffer = 0;
+
+			double fRttMillis = 0.0;
+			double fSendBytesPerSecond = 0.0;
+			double fRecvBytesPerSecond = 0.0;
+			size_t nAdjustments = 0;
+		};
+
+		inline std::ostream& operator<<(std::ostream& os, const socket_report& report)
+		{
+			static const char* sProfiles[] = { "system", "low_latency", "bulk", "fan_out" };
+			return os << sProfiles[size_t(report.nProfile)]
+				<< " nodelay=" << report.bNoDelay << " quickack=" << report.bQuickAck
+				<< " keepalive=" << report.bKeepAlive << " busypoll=" << report.nBusyPollMicros << "us"
+				<< " rcvbuf=" << report.nRecvBuffer << " sndbuf=" << report.nSendBuffer
+				<< " rtt=" << report.fRttMillis << "ms"
+				<< " out=" << report.fSendBytesPerSecond << "B/s in=" << report.fRecvBytesPerSecond << "B/s"
+				<< " adjustments=" << report.nAdjustments;
+		}
+
+		// Applies a socket_tuning to one connection's socket, and keeps its buffers sized to the
+		// link if asked to. Used from the connection's context thread, Report() from anywhere
+		class socket_tuner
+		{
+		public:
+			void Apply(boost::asio::ip::tcp::socket& socket, const socket_tuning& tuning)
+			{
+				using tcp = boost::asio::ip::tcp;
+				boost::system::error_code ec;
+
+				if (tuning.bNoDelay)
+					socket.set_option(tcp::no_delay(true), ec);
+				if (tuning.bKeepAlive)
+					socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
+				if (tuning.nRecvBuffer > 0)
+					socket.set_option(boost::asio::socket_base::receive_buffer_size(tuning.nRecvBuffer), ec);
+				if (tuning.nSendBuffer > 0)
+					socket.set_option(boost::asio::socket_base::send_buffer_size(tuning.nSendBuffer), ec);
+
+#if defined(__linux__)
+				int fd = socket.native_handle();
+				if (tuning.bQuickAck)
+					SetInt(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+				if (tuning.nBusyPollMicros > 0)
+					SetInt(fd, SOL_SOCKET, SO_BUSY_POLL, tuning.nBusyPollMicros);
+				if (tuning.bKeepAlive && tuning.nKeepAliveIdleSeconds > 0)
+				{
+					SetInt(fd, IPPROTO_TCP, TCP_KEEPIDLE, tuning.nKeepAliveIdleSeconds);
+					SetInt(fd, IPPROTO_TCP, TCP_KEEPINTVL, std::max(tuning.nKeepAliveIdleSeconds / 3, 1));
+					SetInt(fd, IPPROTO_TCP, TCP_KEEPCNT, 3);
+				}
+#endif
+
+				m_nSendBuffer = tuning.nSendBuffer;
+				m_nRecvBuffer = tuning.nRecvBuffer;
+				m_nLastBytesOut = 0;
+				m_nLastBytesIn = 0;
+				m_tLast = std::chrono::steady_clock::now();
+
+				std::scoped_lock lock(muxReport);
+				m_report = {};
+				m_report.nProfile = tuning.nProfile;
+				ReadBack(socket);
+			}
+
+			// Quick ACK mode wears off by itself, so it has to be asked for again after reads
+			void RearmQuickAck(boost::asio::ip::tcp::socket& socket)
+			{
+#if defined(__linux__)
+				SetInt(socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK, 1);
+#endif
+			}
+
+			// Resize the buffers for the traffic seen since the last call, given the running byte
+			// counts. A buffer-bound link shows up as throughput of one buffer per round trip, so
+			// a buffer of twice that doubles each time until the link, not the buffer, is the limit.
+			// Idle links give their memory back gradually
+			void Adapt(boost::asio::ip::tcp::socket& socket, const socket_tuning& tuning, uint64_t nBytesOut, uint64_t nBytesIn)
+			{
+				auto tNow = std::chrono::steady_clock::now();
+				double fSeconds = std::chrono::duration<double>(tNow - m_tLast).count();
+				if (fSeconds <= 0.0)
+					return;
+
+				double fOut = double(nBytesOut - m_nLastBytesOut) / fSeconds;
+				double fIn = double(nBytesIn - m_nLastBytesIn) / fSeconds;
+				m_nLastBytesOut = nBytesOut;
+				m_nLastBytesIn = nBytesIn;
+				m_tLast = tNow;
+
+				double fRtt = RoundTripSeconds(socket);
+				bool bAdjusted = false;
+				if (fRtt > 0.0)
+				{
+					boost::system::error_code ec;
+					int nSend = Resize(m_nSendBuffer, fOut * fRtt, tuning);
+					if (nSend != m_nSendBuffer)
+					{
+						socket.set_option(boost::asio::socket_base::send_buffer_size(nSend), ec);
+						m_nSendBuffer = nSend;
+						bAdjusted = true;
+					}
+
+					int nRecv = Resize(m_nRecvBuffer, fIn * fRtt, tuning);
+					if (nRecv != m_nRecvBuffer)
+					{
+						socket.set_option(boost::asio::socket_base::receive_buffer_size(nRecv), ec);
+						m_nRecvBuffer = nRecv;
+						bAdjusted = true;
+					}
+				}
+
+				std::scoped_lock lock(muxReport);
+				m_report.fRttMillis = fRtt * 1000.0;
+				m_report.fSendBytesPerSecond = fOut;
+				m_report.fRecvBytesPerSecond = fIn;
+				if (bAdjusted)
+				{
+					m_report.nAdjustments++;
+					ReadBack(socket);
+				}
+			}
+
+			socket_report Report()
+			{
+				std::scoped_lock lock(muxReport);
+				return m_report;
+			}
+
+			// Forget the last socket, for a pooled connection about to be given another
+			void Reset()
+			{
+				m_nSendBuffer = 0;
+				m_nRecvBuffer = 0;
+				m_nLastBytesOut = 0;
+				m_nLastBytesIn = 0;
+				m_tLast = {};
+
+				std::scoped_lock lock(muxReport);
+				m_report = {};
+			}
+
+		private:
+			// New buffer size for this much data in flight. Changes of less than a quarter are
+			// left alone, so the buffers don't churn with every wobble of the link. A buffer still
+			// at the OS default (which the OS may be tuning itself) is left to it until the link
+			// carries more than the minimum
+			static int Resize(int nCurrent, double fInFlight, const socket_tuning& tuning)
+			{
+				if (nCurrent == 0 && 2.0 * fInFlight < tuning.nMinBuffer)
+					return 0;
+
+				double fTarget = std::clamp(2.0 * fInFlight, double(tuning.nMinBuffer), double(tuning.nMaxBuffer));
+				if (nCurrent > 0)
+				{
+					// Shrink by at most half at a time
+					fTarget = std::max(fTarget, nCurrent / 2.0);
+					if (std::abs(fTarget - nCurrent) < nCurrent / 4.0)
+						return nCurrent;
+				}
+				return int(fTarget);
+			}
+
+			static double RoundTripSeconds(boost::asio::ip::tcp::socket& socket)
+			{
+#if defined(__linux__)
+				tcp_info info{};
+				socklen_t nLength = sizeof(info);
+				if (getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_INFO, &info, &nLength) == 0)
+					return info.tcpi_rtt / 1e6;
+#endif
+				return 0.0;
+			}
+
+			// Fill in the report from the socket itself. muxReport must be held
+			void ReadBack(boost::asio::ip::tcp::socket& socket)
+			{
+				boost::system::error_code ec;
+				boost::asio::ip::tcp::no_delay noDelay;
+				boost::asio::socket_base::keep_alive keepAlive;
+				boost::asio::socket_base::receive_buffer_size recvBuffer;
+				boost::asio::socket_base::send_buffer_size sendBuffer;
+				socket.get_option(noDelay, ec);
+				socket.get_option(keepAlive, ec);
+				socket.get_option(recvBuffer, ec);
+				socket.get_option(sendBuffer, ec);
+				m_report.bNoDelay = noDelay.value();
+				m_report.bKeepAlive = keepAlive.value();
+				m_report.nRecvBuffer = recvBuffer.value();
+				m_report.nSendBuffer = sendBuffer.value();
+
+#if defined(__linux__)
+				m_report.bQuickAck = GetInt(socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK) != 0;
+				m_report.nBusyPollMicros = GetInt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL);
+#endif
+			}
+
+#if defined(__linux__)
+			static void SetInt(int fd, int nLevel, int nOption, int nValue)
+			{
+				setsockopt(fd, nLevel, nOption, &nValue, sizeof(nValue));
+			}
+
+			static int GetInt(int fd, int nLevel, int nOption)
+			{
+				int nValue = 0;
+				socklen_t nLength = sizeof(nValue);
+				if (getsockopt(fd, nLevel, nOption, &nValue, &nLength) != 0)
+					return 0;
+				return nValue;
+			}
+#endif
+
+		private:
+			// Buffer sizes last asked for, zero for the OS default
+			int m_nSendBuffer = 0;
+			int m_nRecvBuffer = 0;
+
+			uint64_t m_nLastBytesOut = 0;
+			uint64_t m_nLastBytesIn = 0;
+			std::chrono::steady_clock::time_point m_tLast;
+
+			std::mutex muxReport;
+			socket_report m_report;
+		};
+	}
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "NetCommon.h"
+#include "NetMessage.h"
+#include "net_mapped_log.h"
+#include "net_outqueue.h"
+#include "net_connection.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// How the server spools messages for clients that have dropped
+		struct spool_config
+		{
+			std::string sDirectory;
+			size_t nReplayBudget = 1024 * 1024;
+			size_t nMaxBytes = 256 * 1024 * 1024;
+			size_t nSegmentSize = 16 * 1024 * 1024;
+		};
+
+		// Head of each spooled record, followed by the message body
+		template<typename T>
+		struct spool_record_header
+		{
+			uint8_t nPriority = 0;
+			uint8_t nReserved[7] = {};
+			message_header<T> header{};
+		};
+
+		// The messages owed to one client identity while it is away, kept on disk in a
+		// mapped_log rather than in memory. It starts with whatever the dropped connection
+		// never finished writing, then takes everything sent to the identity until it returns.
+		// There are no acknowledgements, so where the link died mid write the client may see:
+		//   - the message that was being written sent again, if it had in fact arrived whole.
+		//     A partial frame dies with the link, so otherwise it arrives exactly once, and no
+		//     other message can repeat
+		//   - under TLS, the frames staged into the record being written lost, as they leave
+		//     the queue when staged. The client has some leading run of them, perhaps none
+		//   - a message with a file region lost, as it can't be spooled without the file
+		//
+		// On return the log is streamed to the new connection: up to nReplayBudget bytes are
+		// queued at a time, and the next lot is read each time the connection's queue runs dry,
+		// so a long absence never comes back into memory all at once. Messages sent meanwhile
+		// join the end of the log, so nothing overtakes what was owed. Once the log has been
+		// read to the end the spool is delivered, and messages go straight to the connection.
+		//
+		// Append() is called from the Update() thread, everything else runs on the context
+		// thread; a mutex keeps the two apart
+		template<typename T>
+		class client_spool : public std::enable_shared_from_this<client_spool<T>>
+		{
+		public:
+			// Starts an empty spool at sPath, discarding any left over from before
+			client_spool(const std::string& sPath, const spool_config& config)
+				: m_sPath(sPath), m_config(config),
+				m_pWriter(std::make_unique<mapped_log_writer>(sPath, config.nSegmentSize))
+			{
+
+			}
+
+			~client_spool()
+			{
+				m_pReader.reset();
+				m_pWriter.reset();
+				for (size_t i = 0; std::filesystem::exists(mapped_log_segment_name(m_sPath, i)); i++)
+					std::filesystem::remove(mapped_log_segment_name(m_sPath, i));
+			}
+
+			client_spool(const client_spool<T>&) = delete;
+
+		public:
+			// Spool a message sent while the client is away. Returns false if the spool has
+			// outgrown its limit, in which case it is abandoned and this and later messages lost
+			bool Append(message<T> msg, priority nPriority)
+			{
+				std::scoped_lock lock(muxSpool);
+				if (m_bDelivered)
+				{
+					m_pTarget->Send(std::move(msg), nPriority);
+					return true;
+				}
+
+				// Whatever the dropped connection had queued goes first, so hold on until it is in
+				if (!m_bCaptured)
+				{
+					m_vEarly.push_back({ std::move(msg), nPriority });
+					return true;
+				}
+
+				return Write(msg, nPriority);
+			}
+
+			// Async - Take the messages dropped never wrote. If it dropped part way through a
+			// replay, what it took but didn't write is sent again before the rest of the log
+			void Capture(boost::asio::io_context& asioContext, std::shared_ptr<connection<T>> dropped)
+			{
+				boost::asio::post(asioContext,
+					[self = this->shared_from_this(), dropped = std::move(dropped)]()
+					{
+						std::scoped_lock lock(self->muxSpool);
+						dropped->SetDrainHandler(nullptr);
+						bool bReplaying = self->m_pTarget == dropped;
+						if (bReplaying)
+							self->m_pTarget.reset();
+
+						std::vector<std::pair<message<T>, priority>> vTaken;
+						dropped->TakeUnsent(
+							[&](message<T>& msg, priority nPriority)
+							{
+								if (bReplaying)
+									vTaken.push_back({ std::move(msg), nPriority });
+								else
+									self->Write(msg, nPriority);
+							});
+
+						// They were taken from the front of what was still to resend
+						auto& vResend = self->m_vResend;
+						vResend.erase(vResend.begin(), vResend.begin() + self->m_nResent);
+						vResend.insert(vResend.begin(), std::make_move_iterator(vTaken.begin()), std::make_move_iterator(vTaken.end()));
+						self->m_nResent = 0;
+
+						if (!self->m_bCaptured)
+						{
+							for (auto& [msg, nPriority] : self->m_vEarly)
+								self->Write(msg, nPriority);
+							self->m_vEarly.clear();
+							self->m_bCaptured = true;
+						}
+					});
+			}
+
+			// Async - Stream the spool to the client's new connection
+			void Replay(boost::asio::io_context& asioContext, std::shared_ptr<connection<T>> client)
+			{
+				boost::asio::post(asioContext,
+					[self = this->shared_from_this(), client = std::move(client)]()
+					{
+						{
+							std::scoped_lock lock(self->muxSpool);
+							self->m_pTarget = client;
+						}
+
+						std::weak_ptr<client_spool<T>> weak = self;
+						client->SetDrainHandler(
+							[weak]()
+							{
+								if (auto spool = weak.lock())
+									spool->Pump();
+							});
+						self->Pump();
+					});
+			}
+
+			// Everything spooled has been queued on the new connection
+			bool Delivered()
+			{
+				std::scoped_lock lock(muxSpool);
+				return m_bDelivered;
+			}
+
+			bool Abandoned()
+			{
+				std::scoped_lock lock(muxSpool);
+				return m_bAbandoned;
+			}
+
+		private:
+			// Queue the next nReplayBudget bytes of the spool on the new connection
+			void Pump()
+			{
+				std::scoped_lock lock(muxSpool);
+
+				// A connection that has gone is captured again by the server
+				if (!m_pTarget || !m_pTarget->IsConnected() || m_bDelivered)
+					return;
+
+				size_t nQueued = 0;
+				while (nQueued < m_config.nReplayBudget && m_nResent < m_vResend.size())
+				{
+					auto& [msg, nPriority] = m_vResend[m_nResent++];
+					nQueued += sizeof(message_header<T>) + msg.body.size();
+					m_pTarget->Send(std::move(msg), nPriority);
+				}
+				if (m_nResent == m_vResend.size())
+				{
+					m_vResend.clear();
+					m_nResent = 0;
+				}
+
+				if (!m_pReader)
+					m_pReader = std::make_unique<mapped_log_reader>(m_sPath);
+
+				const uint8_t* pRecord = nullptr;
+				size_t nSize = 0;
+				while (nQueued < m_config.nReplayBudget && m_pReader->Next(pRecord, nSize))
+				{
+					// Skip anything too short to be one of ours, or for a lane there isn't
+					if (nSize < sizeof(spool_record_header<T>))
+						continue;
+
+					spool_record_header<T> head;
+					std::memcpy(&head, pRecord, sizeof(head));
+					if (head.nPriority >= PRIORITY_LANES)
+						continue;
+
+					message<T> msg;
+					msg.header = head.header;
+					msg.body.assign(pRecord + sizeof(head), pRecord + nSize);
+					m_pTarget->Send(std::move(msg), priority(head.nPriority));
+					nQueued += nSize;
+				}
+
+				// Nothing left, and whatever was sent before has been written, so from now on
+				// messages can go straight out
+				if (nQueued == 0)
+				{
+					m_bDelivered = true;
+					m_pTarget->SetDrainHandler(nullptr);
+				}
+			}
+
+			bool Write(const message<T>& msg, priority nPriority)
+			{
+				if (m_bAbandoned)
+					return false;
+
+				size_t nRecord = mapped_log_padded(MAPPED_LOG_RECORD_PREFIX + sizeof(spool_record_header<T>) + msg.body.size());
+				if (m_nBytes + nRecord > m_config.nMaxBytes)
+				{
+					m_bAbandoned = true;
+					return false;
+				}
+
+				spool_record_header<T> head;
+				head.nPriority = uint8_t(nPriority);
+				head.header = msg.header;
+				if (!m_pWriter->Append(&head, sizeof(head), msg.body.data(), msg.body.size()))
+				{
+					m_bAbandoned = true;
+					return false;
+				}
+
+				m_nBytes += nRecord;
+				return true;
+			}
+
+		private:
+			std::string m_sPath;
+			spool_config m_config;
+
+			std::mutex muxSpool;
+			std::unique_ptr<mapped_log_writer> m_pWriter;
+			std::unique_ptr<mapped_log_reader> m_pReader;
+			size_t m_nBytes = 0;
+
+			// Sent before the dropped connection was captured, they go in after what it had queued
+			bool m_bCaptured = false;
+			std::vector<std::pair<message<T>, priority>> m_vEarly;
+
+			// Taken back from a connection that dropped mid replay, they go before the rest of the log
+			std::vector<std::pair<message<T>, priority>> m_vResend;
+			size_t m_nResent = 0;
+
+			// The connection being replayed to
+			std::shared_ptr<connection<T>> m_pTarget;
+			bool m_bDelivered = false;
+			bool m_bAbandoned = false;
+		};
+	}
+}
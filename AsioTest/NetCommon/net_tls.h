@@ -0,0 +1,87 @@
+#pragma once
+
+#include "NetCommon.h"
+
+#ifdef OLC_NET_TLS
+namespace olc
+{
+	namespace net
+	{
+		// Largest payload a single TLS record can carry. Outgoing frames are packed into
+		// writes of about this size, so small messages don't each pay for a record of their own
+		constexpr size_t TLS_RECORD_BYTES = 16 * 1024;
+
+		// Remembers the last session ticket a server gave to a client, so the next connection
+		// to it (a reconnect, or another stream) can resume instead of doing a full handshake.
+		// Attach() it to the client's context, and Apply() it to each new stream before its
+		// handshake. Tickets can arrive after the handshake has finished (always with TLS 1.3),
+		// so they are caught by OpenSSL's new session callback rather than read back afterwards
+		class tls_session_cache
+		{
+		public:
+			tls_session_cache() = default;
+			tls_session_cache(const tls_session_cache&) = delete;
+
+			~tls_session_cache()
+			{
+				if (m_pSession)
+					SSL_SESSION_free(m_pSession);
+			}
+
+		public:
+			void Attach(boost::asio::ssl::context& ctx)
+			{
+				SSL_CTX* pCtx = ctx.native_handle();
+				SSL_CTX_set_session_cache_mode(pCtx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+				SSL_CTX_set_ex_data(pCtx, ExIndex(), this);
+				SSL_CTX_sess_set_new_cb(pCtx, &tls_session_cache::OnNewSession);
+			}
+
+			// Offer the remembered session, if there is one, on a stream about to handshake
+			void Apply(SSL* pSSL)
+			{
+				std::scoped_lock lock(muxSession);
+				if (!m_pSession)
+					return;
+
+				// Each stream gets its own copy, for the same reason as in OnNewSession()
+				if (SSL_SESSION* pCopy = SSL_SESSION_dup(m_pSession))
+				{
+					SSL_set_session(pSSL, pCopy);
+					SSL_SESSION_free(pCopy);
+				}
+			}
+
+		private:
+			static int ExIndex()
+			{
+				static const int nIndex = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+				return nIndex;
+			}
+
+			// Keeps a copy of the session rather than the one OpenSSL gives us. Connections here are
+			// closed without a TLS shutdown, and OpenSSL marks the session of such a connection as
+			// not resumable, which would spoil the cached one if it were shared
+			static int OnNewSession(SSL* pSSL, SSL_SESSION* pSession)
+			{
+				auto* cache = static_cast<tls_session_cache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(pSSL), ExIndex()));
+				SSL_SESSION* pCopy = cache ? SSL_SESSION_dup(pSession) : nullptr;
+				if (!pCopy)
+					return 0;
+
+				std::scoped_lock lock(cache->muxSession);
+				if (cache->m_pSession)
+					SSL_SESSION_free(cache->m_pSession);
+				cache->m_pSession = pCopy;
+
+				// Returning 0 leaves the original to OpenSSL
+				return 0;
+			}
+
+		private:
+			std::mutex muxSession;
+			SSL_SESSION* m_pSession = nullptr;
+		};
+	}
+}
+#endif
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "NetCommon.h"
+
+namespace olc
+{
+	namespace net
+	{
+		// The points in a message's life that can be timestamped. A message going out is
+		// stamped on the sending side, one coming in on the receiving side, the trace itself
+		// never goes over the wire
+		enum class trace_stage : uint8_t
+		{
+			send,			// Send() called, about to be posted to the context
+			enqueue,		// Pushed into the outgoing queue
+			write_start,	// Reached the front of the queue, write issued
+			write_end,		// Write completed
+			read_header,	// Header arrived
+			read_body,		// Body arrived (same as the header if it had none)
+			queued,			// Pushed into the incoming queue
+			dispatch,		// Popped by Update(), handler about to run
+			handled			// Handler returned
+		};
+
+		constexpr size_t TRACE_STAGES = 9;
+
+		// The timestamps of one sampled message
+		struct trace_record
+		{
+			uint32_t nTraceID = 0;
+			std::array<int64_t, TRACE_STAGES> nStamp{};
+		};
+
+		// Carried along with every message, but only a sampled one has a record behind it, so
+		// the rest pay for one pointer and stamping them does nothing. Copying a message copies
+		// its record, each copy then being stamped on its own way
+		class message_trace
+		{
+		public:
+			message_trace() = default;
+			message_trace(message_trace&&) noexcept = default;
+			message_trace& operator=(message_trace&&) noexcept = default;
+
+			message_trace(const message_trace& other)
+				: m_pRecord(other.m_pRecord ? std::make_unique<trace_record>(*other.m_pRecord) : nullptr)
+			{
+
+			}
+
+			message_trace& operator=(const message_trace& other)
+			{
+				if (this != &other)
+					m_pRecord = other.m_pRecord ? std::make_unique<trace_record>(*other.m_pRecord) : nullptr;
+				return *this;
+			}
+
+		public:
+			bool Sampled() const
+			{
+				return m_pRecord != nullptr;
+			}
+
+			void Stamp(trace_stage nStage)
+			{
+				if (m_pRecord)
+					m_pRecord->nStamp[size_t(nStage)] = Now();
+			}
+
+			// Start a record under nTraceID, or pass 0 to drop it
+			void Reset(uint32_t nTraceID)
+			{
+				if (nTraceID == 0)
+				{
+					m_pRecord.reset();
+					return;
+				}
+				m_pRecord = std::make_unique<trace_record>();
+				m_pRecord->nTraceID = nTraceID;
+			}
+
+			const trace_record* Record() const
+			{
+				return m_pRecord.get();
+			}
+
+			static int64_t Now()
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+		private:
+			std::unique_ptr<trace_record> m_pRecord;
+		};
+
+		// Collects the stage timings of one in every nSampleEvery messages into a fixed size ring,
+		// newest overwriting oldest, and dumps them as Chrome trace JSON (chrome://tracing or
+		// ui.perfetto.dev). Each connection is shown as its own track, with a slice for the time
+		// a sampled message spent between each pair of stages it passed through.
+		//
+		// Shared by every connection, so recording is lock free. Dump() can run while traffic
+		// flows, slots being overwritten as it reads are skipped. A writer that comes round the
+		// ring onto a slot another is still filling drops its event rather than tear both
+		class message_tracer
+		{
+		public:
+			message_tracer(size_t nSampleEvery = 100, size_t nCapacity = 65536)
+				: m_nSampleEvery(std::max(nSampleEvery, size_t(1))), m_vSlots(std::max(nCapacity, size_t(1)))
+			{
+				m_nEpoch = message_trace::Now();
+			}
+
+		public:
+			// Start a trace at nStage if this message is one of the sampled ones, otherwise
+			// clear any trace it was carrying
+			void Begin(message_trace& trace, trace_stage nStage)
+			{
+				uint64_t nCount = m_nCount.fetch_add(1, std::memory_order_relaxed);
+				if (nCount % m_nSampleEvery == 0)
+				{
+					trace.Reset(uint32_t(nCount / m_nSampleEvery) + 1);
+					trace.Stamp(nStage);
+				}
+				else
+					trace.Reset(0);
+			}
+
+			// Record the slices of a finished trace, one for each gap between consecutive stages
+			// that were stamped
+			void Commit(const message_trace& trace, uint32_t nConnectionID, uint32_t nMessageID)
+			{
+				const trace_record* pRecord = trace.Record();
+				if (!pRecord)
+					return;
+
+				size_t nPrev = TRACE_STAGES;
+				for (size_t i = 0; i < TRACE_STAGES; i++)
+				{
+					if (pRecord->nStamp[i] == 0)
+						continue;
+
+					if (nPrev != TRACE_STAGES)
+					{
+						event e;
+						e.nTraceID = pRecord->nTraceID;
+						e.nConnectionID = nConnectionID;
+						e.nMessageID = nMessageID;
+						e.nFrom = uint8_t(nPrev);
+						e.nTo = uint8_t(i);
+						e.nStart = pRecord->nStamp[nPrev];
+						e.nEnd = pRecord->nStamp[i];
+						Push(e);
+					}
+					nPrev = i;
+				}
+			}
+
+			// Write everything in the ring to sPath. Returns false if the file can't be written
+			bool Dump(const std::string& sPath)
+			{
+				std::ofstream file(sPath, std::ios::trunc);
+				if (!file)
+					return false;
+
+				file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+				bool bFirst = true;
+				for (auto& slot : m_vSlots)
+				{
+					// Copy the slot, and keep the copy only if it wasn't rewritten meanwhile
+					uint64_t nSeq = slot.nSeq.load(std::memory_order_acquire);
+					if (nSeq == 0 || nSeq == BUSY)
+						continue;
+					event e = slot.Load();
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (slot.nSeq.load(std::memory_order_relaxed) != nSeq)
+						continue;
+
+					file << (bFirst ? "" : ",\n")
+						<< "{\"name\":\"" << StageName(e.nFrom) << " -> " << StageName(e.nTo) << "\""
+						<< ",\"cat\":\"" << (e.nTo <= size_t(trace_stage::write_end) ? "out" : "in") << "\""
+						<< ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.nConnectionID
+						<< ",\"ts\":" << double(e.nStart - m_nEpoch) / 1000.0
+						<< ",\"dur\":" << double(e.nEnd - e.nStart) / 1000.0
+						<< ",\"args\":{\"trace\":" << e.nTraceID << ",\"id\":" << e.nMessageID << "}}";
+					bFirst = false;
+				}
+
+				file << "\n]}\n";
+				return bool(file);
+			}
+
+		private:
+			struct event
+			{
+				uint32_t nTraceID = 0;
+				uint32_t nConnectionID = 0;
+				uint32_t nMessageID = 0;
+				uint8_t nFrom = 0;
+				uint8_t nTo = 0;
+				int64_t nStart = 0;
+				int64_t nEnd = 0;
+			};
+
+			static constexpr size_t EVENT_WORDS = (sizeof(event) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+			// Each slot carries a sequence number, BUSY while it is being written, so a reader
+			// can tell a complete event from one caught half written. The event itself is kept
+			// as atomic words, so reading one mid write is only stale, never a data race
+			struct slot
+			{
+				std::atomic<uint64_t> nSeq = 0;
+				std::array<std::atomic<uint64_t>, EVENT_WORDS> nWords{};
+
+				void Store(const event& e)
+				{
+					uint64_t nRaw[EVENT_WORDS] = {};
+					std::memcpy(nRaw, &e, sizeof(event));
+					for (size_t i = 0; i < EVENT_WORDS; i++)
+						nWords[i].store(nRaw[i], std::memory_order_relaxed);
+				}
+
+				event Load() const
+				{
+					uint64_t nRaw[EVENT_WORDS];
+					for (size_t i = 0; i < EVENT_WORDS; i++)
+						nRaw[i] = nWords[i].load(std::memory_order_relaxed);
+					event e;
+					std::memcpy(&e, nRaw, sizeof(event));
+					return e;
+				}
+			};
+
+			static constexpr uint64_t BUSY = ~uint64_t(0);
+
+			void Push(const event& e)
+			{
+				uint64_t nIndex = m_nNext.fetch_add(1, std::memory_order_relaxed);
+				auto& s = m_vSlots[nIndex % m_vSlots.size()];
+
+				// Claim the slot, unless a writer from a lap behind is still in it
+				uint64_t nSeq = s.nSeq.load(std::memory_order_relaxed);
+				if (nSeq == BUSY || !s.nSeq.compare_exchange_strong(nSeq, BUSY, std::memory_order_relaxed))
+					return;
+
+				std::atomic_thread_fence(std::memory_order_release);
+				s.Store(e);
+				s.nSeq.store(nIndex + 1, std::memory_order_release);
+			}
+
+			static const char* StageName(size_t nStage)
+			{
+				static const char* names[TRACE_STAGES] = {
+					"send", "enqueue", "write_start", "write_end",
+					"read_header", "read_body", "queued", "dispatch", "handled" };
+				return nStage < TRACE_STAGES ? names[nStage] : "?";
+			}
+
+		private:
+			size_t m_nSampleEvery;
+			int64_t m_nEpoch = 0;
+			std::atomic<uint64_t> m_nCount = 0;
+			std::atomic<uint64_t> m_nNext = 0;
+			std::vector<slot> m_vSlots;
+		};
+	}
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "NetCommon.h"
+#include "net_run_mode.h"
 
 namespace olc
 {
@@ -33,6 +34,7 @@ namespace olc
 				std::scoped_lock lock(muxQueue);
 				auto t = std::move(deqQueue.front());
 				deqQueue.pop_front();
+				nCount--;
 				return t;
 			}
 			// Removes and returns item from back of Queue
@@ -41,6 +43,7 @@ namespace olc
 				std::scoped_lock lock(muxQueue);
 				auto t = std::move(deqQueue.back());
 				deqQueue.pop_back();
+				nCount--;
 				return t;
 			}
 
@@ -49,9 +52,25 @@ namespace olc
 			{
 				std::scoped_lock lock(muxQueue);
 				deqQueue.push_back(item);
+				nCount++;
+				notify();
+			}
+			void push_back(T&& item)
+			{
+				std::scoped_lock lock(muxQueue);
+				deqQueue.push_back(std::move(item));
+				nCount++;
+				notify();
+			}
 
-				std::unique_lock<std::mutex> ul(muxBlocking);
-				cvBlocking.notify_one();
+			// Constructs an item in place at back of Queue
+			template<typename... Args>
+			void emplace_back(Args&&... args)
+			{
+				std::scoped_lock lock(muxQueue);
+				deqQueue.emplace_back(std::forward<Args>(args)...);
+				nCount++;
+				notify();
 			}
 			
 			// Adds an item to front of Queue
@@ -59,44 +78,84 @@ namespace olc
 			{
 				std::scoped_lock lock(muxQueue);
 				deqQueue.push_front(item);
-
-				std::unique_lock<std::mutex> ul(muxBlocking);
-				cvBlocking.notify_one();
+				nCount++;
+				notify();
 			}
-			// Returns true if Queue has no items
-			bool empty()
+			void push_front(T&& item)
 			{
 				std::scoped_lock lock(muxQueue);
-				return deqQueue.empty();
+				deqQueue.push_front(std::move(item));
+				nCount++;
+				notify();
+			}
+			// Returns true if Queue has no items. Doesn't lock, so it can be spun on without
+			// getting in the way of whoever is pushing
+			bool empty()
+			{
+				return nCount == 0;
 			}
 			// Returns number of items in Queue
 			size_t count()
 			{
-				std::scoped_lock lock(muxQueue);
-				deqQueue.clear();
+				return nCount;
 			}
 
 			void clear()
 			{
 				std::scoped_lock lock(muxQueue);
 				deqQueue.clear();
+				nCount = 0;
 			}
+			// Blocks until Queue has an item
 			void wait()
 			{
+				if (!empty())
+					return;
+
+				std::unique_lock<std::mutex> ul(muxBlocking);
+				nWaiting++;
+				cvBlocking.wait(ul, [this]() { return !empty(); });
+				nWaiting--;
+			}
+			// Spins for up to tSpin before blocking, to pick an item up without waiting to be
+			// woken. max() spins until one arrives
+			void wait(std::chrono::steady_clock::duration tSpin)
+			{
+				auto tStart = std::chrono::steady_clock::now();
 				while (empty())
+				{
+					if (tSpin != std::chrono::steady_clock::duration::max() &&
+						std::chrono::steady_clock::now() - tStart >= tSpin)
+					{
+						wait();
+						return;
+					}
+					cpu_relax();
+				}
+			}
+		protected:
+			// Only takes muxBlocking when someone is blocked in wait(). Both sides change their
+			// own counter before looking at the other's, so either the waiter sees the item or
+			// the pusher sees the waiter
+			void notify()
+			{
+				if (nWaiting > 0)
 				{
 					std::unique_lock<std::mutex> ul(muxBlocking);
-					cvBlocking.wait(ul);
+					cvBlocking.notify_one();
 				}
 			}
+
 		protected:
 			std::mutex muxQueue;
 			std::deque<T> deqQueue;
+			std::atomic<size_t> nCount = 0;
 
 			// condition_variable 
 			// https://jungwoong.tistory.com/92
 			std::condition_variable cvBlocking;
 			std::mutex muxBlocking;
+			std::atomic<size_t> nWaiting = 0;
 		};
 	}
 }
\ No newline at end of file
@@ -5,4 +5,23 @@
 #include "NetMessage.h"
 #include "net_client.h"
 #include "net_server.h"
-#include "net_connection.h"
\ No newline at end of file
+#include "net_connection.h"
+#include "net_connection_pool.h"
+#include "net_mapped_log.h"
+#include "net_capture.h"
+#include "net_dispatch.h"
+#include "net_crc32c.h"
+#include "net_outqueue.h"
+#include "net_trace.h"
+#include "net_cluster.h"
+#include "net_tls.h"
+#include "net_file.h"
+#include "net_ratelimit.h"
+#include "net_connlist.h"
+#include "net_body_pool.h"
+#include "net_body.h"
+#include "net_fixed.h"
+#include "net_spool.h"
+#include "net_resume.h"
+#include "net_socket_tuning.h"
+#include "net_run_mode.h"
\ No newline at end of file
@@ -11,6 +11,12 @@ enum class CustomMsgTypes : uint32_t
 	TestInt
 };
 
+// Fixed layouts, checked as each frame arrives and kept inline in the message. ServerPing is
+// not one: the server echoes it back untouched, and each client fills it with its own payload
+// (SampleClient a time_point, LoadGenerator a bigger Probe), so there is no one size to hold it to
+template<> struct olc::net::fixed_payload<CustomMsgTypes::MessageAll> { using type = void; };
+template<> struct olc::net::fixed_payload<CustomMsgTypes::TestInt> { using type = int; };
+
 
 class CustomServer : public olc::net::server_interface<CustomMsgTypes>
 {
@@ -21,7 +27,7 @@ protected:
 	{
 		olc::net::message<CustomMsgTypes> msg;
 		msg.header.id = CustomMsgTypes::ServerAccept;
-		client->Send(msg);
+		client->Send(msg, olc::net::priority::control);
 		return true;
 	}
 
@@ -33,41 +39,131 @@ protected:
 	virtual void OnMessage(std::shared_ptr<olc::net::connection<CustomMsgTypes>> client,
 		olc::net::message<CustomMsgTypes>& msg)
 	{
-		switch (msg.header.id)
-		{
-		case CustomMsgTypes::ServerPing:
-		{
-			std::cout << "[" << client->GetID() << "]: Server Ping\n";
+		if (!Dispatcher::Dispatch(*this, client, msg))
+			std::cout << "[" << client->GetID() << "]: Unhandled " << msg << "\n";
+	}
 
-			client->Send(msg);
-		}
-		break;
-		case CustomMsgTypes::MessageAll:
-		{
-			std::cout << "[" << client->GetID() << "]: Message All\n";
+	void OnServerPing(std::shared_ptr<olc::net::connection<CustomMsgTypes>>& client,
+		olc::net::message<CustomMsgTypes>& msg)
+	{
+		std::cout << "[" << client->GetID() << "]: Server Ping\n";
 
-			olc::net::message<CustomMsgTypes> msg;
-			msg.header.id = CustomMsgTypes::ServerMessage;
-			msg << client->GetID();
-			MessageAllClients(msg, client);
-		}
-		break;
-		case CustomMsgTypes::TestInt:
-		{
-			std::cout << "[" << client->GetID() << "]: Server Ping\n";
+		// Ping replies jump the queue, or they'd measure the backlog instead of the link
+		client->Send(msg, olc::net::priority::control);
+	}
 
-			client->Send(msg);
-		}
-		break;
-		}
+	void OnMessageAll(std::shared_ptr<olc::net::connection<CustomMsgTypes>>& client,
+		olc::net::message<CustomMsgTypes>& msg)
+	{
+		std::cout << "[" << client->GetID() << "]: Message All\n";
+
+		olc::net::message<CustomMsgTypes> msgOut;
+		msgOut.header.id = CustomMsgTypes::ServerMessage;
+		msgOut << client->GetID();
+		MessageAllClients(msgOut, client);
+	}
+
+	void OnTestInt(std::shared_ptr<olc::net::connection<CustomMsgTypes>>& client,
+		olc::net::message<CustomMsgTypes>& msg, const int& n)
+	{
+		std::cout << "[" << client->GetID() << "]: Test Int " << n << "\n";
+
+		client->Send(msg);
 	}
+
+	// Message ID -> handler, resolved at compile time into a jump table
+	using Dispatcher = olc::net::message_dispatcher<CustomMsgTypes, CustomServer,
+		olc::net::bind_message<CustomMsgTypes::ServerPing, void, &CustomServer::OnServerPing>,
+		olc::net::bind_fixed<CustomMsgTypes::MessageAll, &CustomServer::OnMessageAll>,
+		olc::net::bind_fixed<CustomMsgTypes::TestInt, &CustomServer::OnTestInt>>;
 };
 
-int main()
+int main(int argc, char* argv[])
 {
-	CustomServer server(60000);
+	// NetServer --replay <capture> : benchmark the handlers against recorded traffic, no network
+	if (argc == 3 && std::string(argv[1]) == "--replay")
+	{
+		CustomServer server(0);
+
+		auto tStart = std::chrono::steady_clock::now();
+		size_t nMessages = server.Replay(argv[2]);
+		std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+
+		std::cout << "[SERVER] Replayed " << nMessages << " messages in " << tElapsed.count() << "s ("
+			<< nMessages / tElapsed.count() << " msgs/s)\n";
+		return 0;
+	}
+
+	// NetServer [--port <port>] [--profile <profile>] [--busy-poll <io core>,<handler core>] [--capture <capture>] [--node <id> --peer-port <port> [--peer <host:port>]... [--allow-peer <host>]...]
+	//   --profile   : socket tuning for every client, system (default), low_latency, bulk or fan_out
+	//   --busy-poll : spin instead of sleeping between messages, the context thread and the
+	//                 Update() thread each keeping the given core busy
+	//   --capture : record everything dispatched while running
+	//   --node    : run as one node of a cluster, e.g. on one machine
+	//               NetServer --port 60000 --node 1 --peer-port 61000 --allow-peer 127.0.0.1
+	//               NetServer --port 60001 --node 2 --peer-port 61001 --peer 127.0.0.1:61000
+	//   --allow-peer : accept peer links from host, as well as from every --peer
+	uint16_t nPort = 60000;
+	uint16_t nPeerPort = 0;
+	int nNode = 0;
+	olc::net::socket_profile nProfile = olc::net::socket_profile::system;
+	std::string sCapture;
+	std::string sBusyPoll;
+	std::vector<std::string> vPeers;
+	std::vector<std::string> vAllowedPeers;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string sArg = argv[i];
+		if (sArg == "--port") nPort = uint16_t(std::stoul(argv[i + 1]));
+		else if (sArg == "--capture") sCapture = argv[i + 1];
+		else if (sArg == "--busy-poll") sBusyPoll = argv[i + 1];
+		else if (sArg == "--profile" && !olc::net::parse_socket_profile(argv[i + 1], nProfile))
+		{
+			std::cerr << "[SERVER] Unknown socket profile " << argv[i + 1] << "\n";
+			return 1;
+		}
+		else if (sArg == "--node") nNode = std::stoi(argv[i + 1]);
+		else if (sArg == "--peer-port") nPeerPort = uint16_t(std::stoul(argv[i + 1]));
+		else if (sArg == "--peer") vPeers.push_back(argv[i + 1]);
+		else if (sArg == "--allow-peer") vAllowedPeers.push_back(argv[i + 1]);
+	}
+
+	CustomServer server(nPort);
+	server.DeclareFixedPayloads<CustomMsgTypes::MessageAll, CustomMsgTypes::TestInt>();
+	server.SetSocketProfile(nProfile);
+
+	if (!sBusyPoll.empty())
+	{
+		size_t nComma = sBusyPoll.find(',');
+		if (nComma == std::string::npos)
+		{
+			std::cerr << "[SERVER] --busy-poll needs <io core>,<handler core>\n";
+			return 1;
+		}
+		server.SetRunMode(olc::net::run_mode::BusyPoll(
+			{ std::stoi(sBusyPoll.substr(0, nComma)) }, { std::stoi(sBusyPoll.substr(nComma + 1)) }));
+	}
+
+	if (!sCapture.empty())
+		server.EnableCapture(sCapture);
+
+	if (nNode > 0)
+	{
+		server.EnableCluster(uint8_t(nNode), nPeerPort);
+		for (auto& sHost : vAllowedPeers)
+			server.AllowPeer(sHost);
+	}
+
 	server.Start();
 
+	for (auto& sPeer : vPeers)
+	{
+		size_t nColon = sPeer.rfind(':');
+		if (nColon != std::string::npos)
+			server.AddPeer(sPeer.substr(0, nColon), uint16_t(std::stoul(sPeer.substr(nColon + 1))));
+	}
+
 	while (true)
 	{
 		server.Update(-1, true);
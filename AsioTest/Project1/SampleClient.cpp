@@ -24,7 +24,7 @@ public:
 		std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
 
 		msg << timeNow;
-		Send(msg);
+		Send(msg, olc::net::priority::control);
 	}
 
 	void MessageAll()